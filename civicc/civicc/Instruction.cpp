@@ -1,9 +1,11 @@
 #include <sstream>
+#include <iomanip>
 #include <vector>
 #include <tuple>
 #include <algorithm>
 #include <string>
 #include <assert.h>
+#include <cmath>
 
 #include "instruction.h"
 
@@ -45,6 +47,25 @@ const std::string Instr::ParseInstr(const std::string instr, const int arg1, con
 	return sstream.str();
 }
 
+int ConstantTable::Index(const std::string type, const std::string value)
+{
+	std::tuple<std::string, std::string> element(type, value);
+	
+	auto it = std::find(constants.begin(), constants.end(), element);
+	if (it != constants.end()) return it - constants.begin();
+
+	constants.push_back(element);
+	return constants.size() - 1;
+}
+
+const std::string ConstantTable::ToString() const
+{
+	std::stringstream sstream;
+	for (auto it = constants.begin(); it < constants.end(); ++it)
+		sstream << ".const " << std::get<0>(*it) << " " << std::get<1>(*it) << std::endl;
+	return sstream.str();
+}
+
 const std::string ArithInstr::iAdd = "iadd";
 const std::string ArithInstr::fAdd = "fadd";
 
@@ -110,16 +131,24 @@ const std::string ArithInstr::Not(Instr::Type type)
 	return bNot;
 }
 
-const std::string ArithInstr::Increment(const std::string local, const int constant)
+const std::string ArithInstr::Increment(ConstantTable& constants, const int local, const int value)
 {
-	if (constant == 1) return Instr::ParseInstr(iInc_1, local);
-	return Instr::ParseInstr(iInc, local, constant);
+	if (value == 1) return Instr::ParseInstr(iInc_1, local);
+	if (value < 0) return Decrement(constants, local, -value);
+
+	std::stringstream sstream;
+	sstream << value;
+	return Instr::ParseInstr(iInc, local, constants.Index(Instr::TypeNames::Int, sstream.str()));
 }
 
-const std::string ArithInstr::Decrement(const std::string local, const int constant)
+const std::string ArithInstr::Decrement(ConstantTable& constants, const int local, const int value)
 {
-	if (constant == 1) return Instr::ParseInstr(iDec_1, local);
-	return Instr::ParseInstr(iDec, local, constant);
+	if (value == 1) return Instr::ParseInstr(iDec_1, local);
+	if (value < 0) return Increment(constants, local, -value);
+
+	std::stringstream sstream;
+	sstream << value;
+	return Instr::ParseInstr(iDec, local, constants.Index(Instr::TypeNames::Int, sstream.str()));
 }
 
 const std::string CompInstr::iNotEqual = "ine";
@@ -133,8 +162,8 @@ const std::string CompInstr::fNotEqual = "fne";
 const std::string CompInstr::fEqual = "feq";
 const std::string CompInstr::fLess = "flt";
 const std::string CompInstr::fLessEqual = "fle";
-const std::string CompInstr::fGreater = "igt";
-const std::string CompInstr::fGreaterEqual = "ige";
+const std::string CompInstr::fGreater = "fgt";
+const std::string CompInstr::fGreaterEqual = "fge";
 
 const std::string CompInstr::bNotEqual = "bne";
 const std::string CompInstr::bEqual = "beq";
@@ -255,8 +284,6 @@ const std::string CntrlFlwInstr::Branch(bool condition, const std::string label)
 	return (condition) ? Instr::ParseInstr(branch_t, label) : Instr::ParseInstr(branch_f, label);
 }
 
-std::vector<std::tuple<std::string, std::string>> VarInstr::constants;
-
 const std::string VarInstr::iLoad = "iload";
 const std::string VarInstr::fLoad = "fload";
 const std::string VarInstr::bLoad = "bload";
@@ -365,7 +392,7 @@ const std::string VarInstr::StoreGlobal(Instr::Type type, const int index)
 	return Instr::ParseInstr(instr, index);
 }
 
-const std::string VarInstr::LoadConstant(const int value)
+const std::string VarInstr::LoadConstant(ConstantTable& constants, const int value)
 {
 	std::stringstream sstream;
 	if (value >= 0 && value <= 1)
@@ -380,13 +407,14 @@ const std::string VarInstr::LoadConstant(const int value)
 	}
 
 	sstream << value;
-	return LoadConstant(iLoadC, sstream.str(), Instr::TypeNames::Int);
+	return LoadConstant(constants, iLoadC, sstream.str(), Instr::TypeNames::Int);
 }
 
-const std::string VarInstr::LoadConstant(const float value)
+const std::string VarInstr::LoadConstant(ConstantTable& constants, const float value)
 {
 	std::stringstream sstream;
-	if (value == 0.0f)
+	// floadc_0 would turn -0.0 into 0.0
+	if (value == 0.0f && !std::signbit(value))
 	{
 		sstream << fLoadC << "_0";
 		return sstream.str();
@@ -397,8 +425,9 @@ const std::string VarInstr::LoadConstant(const float value)
 		return sstream.str();
 	}
 	
-	sstream << value;
-	return LoadConstant(fLoadC, sstream.str(), Instr::TypeNames::Float);
+	// Nine significant digits are needed to round-trip every float.
+	sstream << std::setprecision(9) << value;
+	return LoadConstant(constants, fLoadC, sstream.str(), Instr::TypeNames::Float);
 }
 
 const std::string VarInstr::LoadConstant(const bool value)
@@ -406,30 +435,10 @@ const std::string VarInstr::LoadConstant(const bool value)
 	return (value) ? bLoadCT : bLoadCF;
 }
 
-const std::string VarInstr::LoadConstant(const std::string instr, const std::string value, const std::string type)
+const std::string VarInstr::LoadConstant(ConstantTable& constants, const std::string instr, const std::string value, const std::string type)
 {
-	int index = -1;
-	std::tuple<std::string, std::string> element(type, value);
-	
-	for (auto it = constants.begin(); it < constants.end(); ++it)
-		if (*it == element) index = it - constants.begin();
-
-	if (index == -1)
-	{
-		constants.push_back(element);
-		index = constants.size() - 1;
-	}
-	
 	std::stringstream sstream;	
-	sstream << instr << " " << index;
-	return sstream.str();
-}
-
-const std::string VarInstr::GetConstantTable()
-{
-	std::stringstream sstream;
-	for (auto it = constants.begin(); it < constants.end(); ++it)
-		sstream << ".const " << std::get<0>(*it) << " " << std::get<1>(*it) << std::endl;
+	sstream << instr << " " << constants.Index(type, value);
 	return sstream.str();
 }
 
@@ -464,7 +473,7 @@ const std::string ArrayInstr::Read(const Instr::Type type)
 {
 	assert(type == Instr::Int || type == Instr::Float || type == Instr::Bool);
 	if (type == Instr::Int) return iRead;
-	if (type == Instr::Float) return iRead;
+	if (type == Instr::Float) return fRead;
 	return bRead;
 }
 
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include "array_lowering.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+struct ArrayContext
+{
+	std::vector<NodePtr> locals;
+	int counter = 0;
+	int constantSizes = 0;
+	int fills = 0;
+};
+
+NodePtr Dimensions(NodePtr dec)
+{
+	auto varDec = StaticCast<VarDec>(dec);
+	if(varDec) return varDec->children[0];
+	return StaticCast<GlobalDef>(dec)->children[0];
+}
+
+// The product of the dimensions, a literal when they all are
+NodePtr ElementCount(NodePtr dimensions, ArrayContext& context)
+{
+	int64_t product = 1;
+	bool constant = true;
+
+	for(auto dim : dimensions->children)
+	{
+		auto literal = StaticCast<Literal>(dim);
+		if(!literal)
+		{
+			constant = false;
+			break;
+		}
+
+		product *= literal->intValue;
+		if(product > std::numeric_limits<int>::max()) constant = false;
+	}
+
+	if(constant)
+	{
+		context.constantSizes++;
+		return std::make_shared<Literal>((int)product);
+	}
+
+	NodePtr count = nullptr;
+	for(auto dim : dimensions->children)
+	{
+		std::map<NodePtr, NodePtr> clones;
+		auto copy = Clone(dim, clones);
+		if(!count)
+		{
+			count = copy;
+			continue;
+		}
+
+		auto multiply = std::make_shared<BinaryOp>(Operator::Multiply);
+		multiply->type = Type::Int;
+		multiply->children = { count, copy };
+		count = multiply;
+	}
+	return count;
+}
+
+void FlattenElements(NodePtr expr, std::vector<NodePtr>& elements)
+{
+	if(!expr->IsFamily<ArrayExpr>())
+	{
+		elements.push_back(expr);
+		return;
+	}
+
+	for(auto child : expr->children) FlattenElements(child, elements);
+}
+
+bool SameLiteral(NodePtr a, NodePtr b)
+{
+	auto x = StaticCast<Literal>(a), y = StaticCast<Literal>(b);
+	if(!x || !y || x->type != y->type) return false;
+
+	if(x->type == Type::Int) return x->intValue == y->intValue;
+	if(x->type == Type::Float) return x->floatValue == y->floatValue;
+	return x->boolValue == y->boolValue;
+}
+
+std::shared_ptr<VarDec> ArrayLocal(ArrayContext& context, Type type, const std::string& name)
+{
+	std::stringstream sstream;
+	sstream << "_A" << context.counter++ << name;
+
+	auto local = std::make_shared<VarDec>();
+	local->var.type = type;
+	local->var.name = sstream.str();
+	context.locals.push_back(local);
+	return local;
+}
+
+// Moves the initialiser into the allocation, returns whether it did
+bool LowerInitialiser(std::shared_ptr<AllocateArray> alloc, NodePtr next, ArrayContext& context)
+{
+	auto assign = StaticCast<Assignment>(next);
+	if(!assign || assign->dec != alloc->dec || assign->children.size() != 1) return false;
+
+	NodePtr init = assign->children[0];
+	if(init->IsFamily<ArrayExpr>())
+	{
+		auto flat = std::make_shared<ArrayExpr>();
+		FlattenElements(init, flat->children);
+
+		bool uniform = flat->children.size() > 1 && std::all_of(flat->children.begin(), flat->children.end(), [&](NodePtr element)
+		{
+			return SameLiteral(element, flat->children[0]);
+		});
+		init = uniform ? flat->children[0] : flat;
+	}
+
+	alloc->children.push_back(init);
+	if(init->IsFamily<ArrayExpr>()) return true;
+
+	context.fills++;
+	// The initialiser is evaluated once, whether or not the fill is unrolled
+	if(!init->IsFamily<Literal>() && !init->IsFamily<Identifier>()) alloc->value = ArrayLocal(context, alloc->type, "value");
+
+	auto size = StaticCast<Literal>(alloc->children[0]);
+	if(size && size->intValue <= FillUnrollLimit) return true;
+
+	alloc->counter = ArrayLocal(context, Type::Int, "count");
+	return true;
+}
+
+void LowerArrays(NodePtr root, Statistics& statistics)
+{
+	ArrayContext context;
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		auto& list = funDef->children;
+
+		for(size_t i = 0; i < list.size(); ++i)
+		{
+			auto alloc = StaticCast<AllocateArray>(list[i]);
+			if(!alloc || !alloc->children.empty()) continue;
+
+			alloc->children.push_back(ElementCount(Dimensions(alloc->dec), context));
+			if(i + 1 < list.size() && LowerInitialiser(alloc, list[i + 1], context)) list.erase(list.begin() + i + 1);
+		}
+
+		list.insert(list.begin(), context.locals.begin(), context.locals.end());
+		context.locals.clear();
+	});
+
+	statistics["array_lowering.constant_sizes"] += context.constantSizes;
+	statistics["array_lowering.fills"] += context.fills;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Most elements a fill is unrolled for, larger or unknown sizes get a loop
+const int FillUnrollLimit = 8;
+
+// Prepares array allocations for the generator. The dimensions are multiplied
+// into the number of elements, at compile time when they are all literals.
+// The initialiser that follows the allocation is moved into it: nested array
+// literals are flattened, literals with a single repeated value and scalar
+// initialisers become fills, and fills that are not unrolled get a counter
+// local. Constant sizes are counted under "array_lowering.constant_sizes" and
+// fills under "array_lowering.fills".
+void LowerArrays(Nodes::NodePtr root, Statistics& statistics);
@@ -1,6 +1,8 @@
 #include <sstream>
 #include <map>
+#include <set>
 #include <algorithm>
+#include <limits>
 
 #include "instruction.h"
 #include "assembly.h"
@@ -22,6 +24,41 @@ Instr::Type NodeTypeToInstrType(Type type)
 	return map.at(type);
 }
 
+int InstructionCount(NodePtr root)
+{
+	int count = 0;
+
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		auto cast = StaticCast<Cast>(node);
+		if(cast) count += cast->castFrom != cast->type;
+		else if(node->IsFamily<Ternary>()) count += 2;
+		else if(node->IsFamily<Literal>() || node->IsFamily<Identifier>() || node->IsFamily<Call>()) count++;
+		else if(node->IsFamily<UnaryOp>() || node->IsFamily<BinaryOp>()) count++;
+	});
+
+	return count;
+}
+
+// Numbers the nodes of a function body in evaluation order, skipping nested
+// functions, and records the position range of every loop
+void OrderNodes(NodePtr node, std::map<NodePtr, int>& positions, std::vector<std::pair<int, int>>& loops)
+{
+	int begin = (int)positions.size();
+	positions[node] = begin;
+
+	for(auto child : node->children)
+	{
+		if(!child->IsFamily<FunctionDef>()) OrderNodes(child, positions, loops);
+	}
+
+	if(node->IsFamily<DoWhile>()) loops.push_back({ begin, (int)positions.size() - 1 });
+}
+
+AssemblyGenerator::AssemblyGenerator(bool reuseSlots, Statistics& statistics) : reuseSlots(reuseSlots), statistics(statistics)
+{
+}
+
 std::string AssemblyGenerator::Generate(NodePtr root)
 {
 	std::stringstream sstream;
@@ -34,11 +71,11 @@ std::string AssemblyGenerator::Generate(NodePtr root)
 		if(funDef) sstream << FunDef(funDef);
 
 		auto globalDef = StaticCast<GlobalDef>(node);
-		if(globalDef) globals.push_back(TypeToString(globalDef->var.type));
+		if(globalDef) globals.push_back(TypeToString(globalDef->var.type) + (globalDef->var.array ? "[]" : ""));
 	});
 
 	sstream << "\n; globals:\n";
-	sstream << VarInstr::GetConstantTable();
+	sstream << constants.ToString();
 
 	for(const auto& global : globals) sstream << ".global " << global << '\n';
 	for(const auto& imp : imports) sstream << imp << '\n';
@@ -49,33 +86,23 @@ std::string AssemblyGenerator::Generate(NodePtr root)
 
 void AssemblyGenerator::BuildTables(Nodes::NodePtr root)
 {
-	int frame = 0, index = 0;
-	NodePtr prev = root, prevParent = nullptr;
-	
-	NodePtr curDef = nullptr;
+	// Static nesting depth of the function each node belongs to, top-level functions being 0
+	std::map<NodePtr, int> frames;
+	frames[root] = -1;
+
 	TraverseBreadth(root, [&](NodePtr node, NodePtr parent)
 	{
+		if(!parent) return;
+
+		int frame = frames[parent];
 		auto funDef = StaticCast<FunctionDef>(node);
 		if(funDef)
 		{
-			curDef = funDef;
-			if(prev != parent)
-			{
-				frame++;
-				prev = parent;
-			}
-			
+			frame++;
 			functionNestingTable[funDef] = frame;
+			AllocateLocals(funDef);
 		}
-		auto parentFun = StaticCast<FunctionDef>(parent);
-		if(parentFun)
-		{
-			if(prevParent != parentFun)
-			{
-				index = parentFun->header.params.size();
-				prevParent = parentFun;
-			}
-		}
+		frames[node] = frame;
 
 		auto funDec = StaticCast<FunctionDec>(node);
 		if(funDec)
@@ -91,19 +118,130 @@ void AssemblyGenerator::BuildTables(Nodes::NodePtr root)
 			int index = (int)globalIndexTable.size();
 			globalIndexTable[node] = index;
 		}
-		if(node->IsFamily<VarDec>()) localTable[node] = { frame, index++ };
+		if(node->IsFamily<VarDec>()) localTable[node].frame = frame;
 		if(node->IsFamily<Assignment>()) assignFrameTable[node] = frame;
 		if(node->IsFamily<Identifier>()) idFrameTable[node] = frame;
-		if(node->IsFamily<Call>())
+		if(node->IsFamily<Call>()) functionCallTable[node] = frame;
+	});
+}
+
+void AssemblyGenerator::AllocateLocals(std::shared_ptr<FunctionDef> root)
+{
+	int slots = (int)root->header.params.size();
+	std::vector<NodePtr> varDecs;
+	TraverseNot<FunctionDef>(root, [&](NodePtr node, NodePtr)
+	{
+		if(node->IsFamily<VarDec>()) varDecs.push_back(node);
+	});
+
+	if(!reuseSlots)
+	{
+		for(auto varDec : varDecs) localTable[varDec].index = slots++;
+		frameSizeTable[root] = (int)varDecs.size();
+		return;
+	}
+
+	std::map<NodePtr, int> positions;
+	std::vector<std::pair<int, int>> loops;
+	OrderNodes(root, positions, loops);
+
+	// Live range of every local, from its first to its last reference
+	std::map<NodePtr, std::pair<int, int>> ranges;
+	std::set<NodePtr> pinned;
+	for(auto varDec : varDecs)
+	{
+		ranges[varDec] = { std::numeric_limits<int>::max(), -1 };
+		if(std::static_pointer_cast<VarDec>(varDec)->var.array) pinned.insert(varDec);
+	}
+
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		auto id = StaticCast<Identifier>(node);
+		auto assign = StaticCast<Assignment>(node);
+		NodePtr dec = id ? id->dec : assign ? assign->dec : nullptr;
+		if(!dec || !ranges.count(dec)) return;
+
+		// Nested functions can access the slot at any time they are called
+		if(!positions.count(node))
 		{
-			functionCallTable[node] = curDef && Count(curDef, node) ? frame + 1 : frame;
+			pinned.insert(dec);
+			return;
 		}
+
+		auto& range = ranges[dec];
+		range.first = std::min(range.first, positions[node]);
+		range.second = std::max(range.second, positions[node]);
+	});
+
+	for(auto& pair : ranges)
+	{
+		if(pair.second.second < 0) pair.second = { positions[pair.first], positions[pair.first] };
+	}
+
+	// A value can flow around a loop's back edge, so a range that touches a loop covers all of it
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(auto& pair : ranges)
+		{
+			auto& range = pair.second;
+			for(const auto& loop : loops)
+			{
+				if(range.first > loop.second || range.second < loop.first) continue;
+				if(range.first <= loop.first && range.second >= loop.second) continue;
+
+				range.first = std::min(range.first, loop.first);
+				range.second = std::max(range.second, loop.second);
+				changed = true;
+			}
+		}
+	}
+
+	// The generator uses these for array fills, outside of any expression
+	TraverseNot<FunctionDef>(root, [&](NodePtr node, NodePtr)
+	{
+		auto alloc = StaticCast<AllocateArray>(node);
+		if(alloc && alloc->counter) pinned.insert(alloc->counter);
+		if(alloc && alloc->value) pinned.insert(alloc->value);
+	});
+
+	for(auto varDec : varDecs) if(pinned.count(varDec)) localTable[varDec].index = slots++;
+
+	std::sort(varDecs.begin(), varDecs.end(), [&](NodePtr a, NodePtr b)
+	{
+		return ranges[a].first < ranges[b].first;
 	});
+
+	// Slots are only shared between variables of the same type, with the range that last used them
+	std::vector<std::pair<Type, int>> slotEnds;
+	std::vector<int> slotIndices;
+	for(auto varDec : varDecs)
+	{
+		if(pinned.count(varDec)) continue;
+
+		auto type = std::static_pointer_cast<VarDec>(varDec)->var.type;
+		const auto& range = ranges[varDec];
+
+		size_t slot = 0;
+		while(slot < slotEnds.size() && (slotEnds[slot].first != type || slotEnds[slot].second >= range.first)) slot++;
+
+		if(slot == slotEnds.size())
+		{
+			slotEnds.push_back({ type, range.second });
+			slotIndices.push_back(slots++);
+		}
+		else slotEnds[slot].second = range.second;
+
+		localTable[varDec].index = slotIndices[slot];
+	}
+
+	frameSizeTable[root] = slots - (int)root->header.params.size();
+	statistics["assembly.slots_saved"] += (int)varDecs.size() - frameSizeTable[root];
 }
 
 std::string AssemblyGenerator::FunDef(std::shared_ptr<FunctionDef> root)
 {
-	int varCount = 0;
 	std::stringstream sstream;
 
 	if(root->exp)
@@ -116,11 +254,15 @@ std::string AssemblyGenerator::FunDef(std::shared_ptr<FunctionDef> root)
 
 	sstream << root->header.name << ":\n";
 
+	sstream << '\t' << CntrlFlwInstr::EnterSub(frameSizeTable[root]) << "\n";
+
+	bool tailCalls = false;
 	TraverseNot<FunctionDef>(root, [&](NodePtr node, NodePtr parent)
 	{
-		if(node->IsFamily<VarDec>()) varCount++;
+		auto call = StaticCast<Call>(node);
+		if(call && call->tail) tailCalls = true;
 	});
-	sstream << '\t' << CntrlFlwInstr::EnterSub(varCount) << "\n";
+	if(tailCalls) sstream << root->header.name << "_tail_entry:\n";
 
 
 	TraverseBreadth(root, [&](NodePtr node, NodePtr parent)
@@ -148,6 +290,9 @@ std::string AssemblyGenerator::Assign(std::shared_ptr<Assignment> root)
 	std::stringstream sstream;
 	Instr::Type type = NodeTypeToInstrType(root->type);
 
+	std::string increment = Increment(root);
+	if(!increment.empty()) return increment;
+
 	sstream << Expression(root);
 
 	if(root->dec->IsFamily<VarDec>())
@@ -181,6 +326,35 @@ std::string AssemblyGenerator::Assign(std::shared_ptr<Assignment> root)
 	return sstream.str();
 }
 
+std::string AssemblyGenerator::Increment(std::shared_ptr<Assignment> root)
+{
+	// Matches 'x = x + c', 'x = c + x' and 'x = x - c' on an int local of the current frame.
+	if(!root->dec->IsFamily<VarDec>() || assignFrameTable[root] != localTable[root->dec].frame) return "";
+
+	auto binOp = StaticCast<BinaryOp>(root->children[0]);
+	if(!binOp || binOp->type != Type::Int) return "";
+	if(binOp->op != Operator::Add && binOp->op != Operator::Subtract) return "";
+
+	auto id = StaticCast<Identifier>(binOp->children[0]);
+	auto literal = StaticCast<Literal>(binOp->children[1]);
+	if(binOp->op == Operator::Add && !(id && literal))
+	{
+		id = StaticCast<Identifier>(binOp->children[1]);
+		literal = StaticCast<Literal>(binOp->children[0]);
+	}
+
+	if(!id || !literal || id->dec != root->dec) return "";
+	if(literal->intValue == 0 || literal->intValue == std::numeric_limits<int>::min()) return "";
+
+	std::stringstream sstream;
+	int index = localTable[root->dec].index;
+
+	if(binOp->op == Operator::Add) sstream << '\t' << ArithInstr::Increment(constants, index, literal->intValue) << '\n';
+	else sstream << '\t' << ArithInstr::Decrement(constants, index, literal->intValue) << '\n';
+
+	return sstream.str();
+}
+
 std::string AssemblyGenerator::FunCall(std::shared_ptr<Call> call, bool expr)
 {
 	std::stringstream sstream;
@@ -197,6 +371,19 @@ std::string AssemblyGenerator::FunCall(std::shared_ptr<Call> call, bool expr)
 			sstream << '\t' << StackInstr::Pop(NodeTypeToInstrType(funDec->header.returnType)) << '\n';
 		}
 	}
+	else if(call->tail)
+	{
+		// Reuse the current frame: overwrite the parameters and start over
+		auto funDef = StaticCast<FunctionDef>(call->dec);
+		const auto& params = funDef->header.params;
+
+		for(auto child : call->children) sstream << Expression(child);
+		for(size_t i = params.size(); i-- > 0;)
+		{
+			sstream << '\t' << VarInstr::StoreLocal(NodeTypeToInstrType(params[i].type), i) << '\n';
+		}
+		sstream << '\t' << CntrlFlwInstr::Jump(funDef->header.name + "_tail_entry") << '\n';
+	}
 	else
 	{
 		auto funDef = StaticCast<FunctionDef>(call->dec);
@@ -205,9 +392,9 @@ std::string AssemblyGenerator::FunCall(std::shared_ptr<Call> call, bool expr)
 
 		sstream << '\t';
 		if(funFrame == 0) sstream << CntrlFlwInstr::InitiateSub(CntrlFlwInstr::Scope::Global);
-		else if((callFrame - funFrame) == 1 && (Count(funDef, call) > 0)) sstream << CntrlFlwInstr::InitiateSub(CntrlFlwInstr::Scope::Current);
-		else if(funFrame == callFrame) sstream << CntrlFlwInstr::InitiateSub(CntrlFlwInstr::Scope::Local);
-		else sstream << CntrlFlwInstr::InitiateSub(CntrlFlwInstr::Scope::Outer, callFrame - funFrame - 1);
+		else if(funFrame == callFrame + 1) sstream << CntrlFlwInstr::InitiateSub(CntrlFlwInstr::Scope::Local);
+		else if(funFrame == callFrame) sstream << CntrlFlwInstr::InitiateSub(CntrlFlwInstr::Scope::Current);
+		else sstream << CntrlFlwInstr::InitiateSub(CntrlFlwInstr::Scope::Outer, callFrame - funFrame);
 		sstream << '\n';
 
 		for(auto child : call->children) sstream << Expression(child);
@@ -243,21 +430,24 @@ std::string AssemblyGenerator::Expression(NodePtr root)
 		{ Operator::LessEqual, &CompInstr::LessEqual },
 	});
 
+	// Operands of calls and ternaries, at any depth, are generated by FunCall and the ternary itself
+	std::set<NodePtr> nested;
+	TraverseBreadth(root, [&](NodePtr node, NodePtr parent)
+	{
+		if(parent && (nested.count(parent) || parent->IsFamily<Call>() || parent->IsFamily<Ternary>())) nested.insert(node);
+	});
+
 	TraverseDepth(root, [&](NodePtr node, NodePtr parent)
 	{
-		if(parent)
-		{
-			if(parent->IsFamily<Call>()) return;
-			if(parent->IsFamily<Ternary>()) return;
-		}
+		if(nested.count(node)) return;
 
 		auto literal = StaticCast<Literal>(node);
 		if(literal)
 		{
 			if(!parent || parent && !parent->IsFamily<Ternary>())
 			{
-				if(literal->type == Type::Int) sstream << '\t' << VarInstr::LoadConstant(literal->intValue) << '\n';
-				else if(literal->type == Type::Float) sstream << '\t' << VarInstr::LoadConstant(literal->floatValue) << '\n';
+				if(literal->type == Type::Int) sstream << '\t' << VarInstr::LoadConstant(constants, literal->intValue) << '\n';
+				else if(literal->type == Type::Float) sstream << '\t' << VarInstr::LoadConstant(constants, literal->floatValue) << '\n';
 				else sstream << '\t' << VarInstr::LoadConstant(literal->boolValue) << '\n';
 			}
 		}
@@ -365,10 +555,79 @@ std::string AssemblyGenerator::ArrayDec(NodePtr root)
 	std::stringstream sstream;
 
 	auto alloc = StaticCast<AllocateArray>(root);
-	if(alloc)
+	if(!alloc) return "";
+
+	auto type = NodeTypeToInstrType(alloc->type);
+	auto global = alloc->dec->IsFamily<GlobalDef>();
+	int index = global ? globalIndexTable[alloc->dec] : localTable[alloc->dec].index;
+	auto loadArray = global ? VarInstr::LoadGlobal(Instr::Array, index) : VarInstr::LoadLocal(Instr::Array, index);
+
+	sstream << Expression(alloc->children[0]);
+	if(alloc->counter)
 	{
-		sstream << '\t' << ArrayInstr::New(NodeTypeToInstrType(alloc->type), 1) << '\n';
+		int counter = localTable[alloc->counter].index;
+		sstream << '\t' << VarInstr::StoreLocal(Instr::Int, counter) << '\n';
+		sstream << '\t' << VarInstr::LoadLocal(Instr::Int, counter) << '\n';
 	}
+	sstream << '\t' << ArrayInstr::New(type, 1) << '\n';
+	sstream << '\t' << (global ? VarInstr::StoreGlobal(Instr::Array, index) : VarInstr::StoreLocal(Instr::Array, index)) << '\n';
+
+	if(alloc->children.size() < 2) return sstream.str();
+	auto init = alloc->children[1];
+
+	// One store per element of an array literal
+	if(init->IsFamily<ArrayExpr>())
+	{
+		for(size_t i = 0; i < init->children.size(); ++i)
+		{
+			sstream << Expression(init->children[i]);
+			sstream << '\t' << VarInstr::LoadConstant(constants, (int)i) << '\n';
+			sstream << '\t' << loadArray << '\n';
+			sstream << '\t' << ArrayInstr::Store(type) << '\n';
+		}
+		return sstream.str();
+	}
+
+	std::string value = Expression(init);
+	if(alloc->value)
+	{
+		int slot = localTable[alloc->value].index;
+		sstream << value << '\t' << VarInstr::StoreLocal(type, slot) << '\n';
+		value = '\t' + VarInstr::LoadLocal(type, slot) + '\n';
+	}
+
+	if(!alloc->counter)
+	{
+		int size = StaticCast<Literal>(alloc->children[0])->intValue;
+		for(int i = 0; i < size; ++i)
+		{
+			sstream << value;
+			sstream << '\t' << VarInstr::LoadConstant(constants, i) << '\n';
+			sstream << '\t' << loadArray << '\n';
+			sstream << '\t' << ArrayInstr::Store(type) << '\n';
+		}
+		return sstream.str();
+	}
+
+	// Fill from the last element down, the counter starts at the number of elements
+
+	std::stringstream label;
+	label << labelCounter++;
+	std::string loop = label.str() + "_fill", end = label.str() + "_fill_end";
+	int counter = localTable[alloc->counter].index;
+
+	sstream << loop << ":\n";
+	sstream << '\t' << VarInstr::LoadLocal(Instr::Int, counter) << '\n';
+	sstream << '\t' << VarInstr::LoadConstant(constants, 0) << '\n';
+	sstream << '\t' << CompInstr::Greater(Instr::Int) << '\n';
+	sstream << '\t' << CntrlFlwInstr::Branch(false, end) << '\n';
+	sstream << '\t' << ArithInstr::Decrement(constants, counter, 1) << '\n';
+	sstream << value;
+	sstream << '\t' << VarInstr::LoadLocal(Instr::Int, counter) << '\n';
+	sstream << '\t' << loadArray << '\n';
+	sstream << '\t' << ArrayInstr::Store(type) << '\n';
+	sstream << '\t' << CntrlFlwInstr::Jump(loop) << '\n';
+	sstream << end << ":\n";
 
 	return sstream.str();
 }
@@ -4,11 +4,20 @@
 #include <map>
 
 #include "node.h"
+#include "instruction.h"
+#include "statistics.h"
 
 
+// Number of instructions the generator emits for an expression
+int InstructionCount(Nodes::NodePtr root);
+
 class AssemblyGenerator
 {
 public:
+	// With reuseSlots, locals whose live ranges do not overlap share a frame slot.
+	// The slots saved are counted under "assembly.slots_saved".
+	AssemblyGenerator(bool reuseSlots, Statistics& statistics);
+
 	std::string Generate(Nodes::NodePtr root);
 
 private:
@@ -18,6 +27,9 @@ private:
 	};
 
 	int labelCounter = 0;
+	bool reuseSlots;
+	Statistics& statistics;
+	ConstantTable constants;
 
 	std::vector<std::string> exports, imports, globals;
 
@@ -28,11 +40,14 @@ private:
 	std::map<Nodes::NodePtr, int> idFrameTable;
 	std::map<Nodes::NodePtr, int> functionNestingTable;
 	std::map<Nodes::NodePtr, int> functionCallTable;
+	std::map<Nodes::NodePtr, int> frameSizeTable;
 
 	void BuildTables(Nodes::NodePtr root);
+	void AllocateLocals(std::shared_ptr<Nodes::FunctionDef> root);
 
 	std::string FunDef(std::shared_ptr<Nodes::FunctionDef> root);
 	std::string Assign(std::shared_ptr<Nodes::Assignment> root);
+	std::string Increment(std::shared_ptr<Nodes::Assignment> root);
 	std::string FunCall(std::shared_ptr<Nodes::Call> call, bool expr);
 	std::string Expression(Nodes::NodePtr root);
 	std::string Statements(Nodes::NodePtr root);
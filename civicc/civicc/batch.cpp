@@ -0,0 +1,122 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <map>
+
+#include "batch.h"
+
+
+struct BatchItem
+{
+	std::string input, output;
+	bool success = false;
+	std::string report;
+};
+
+static std::string OutputFilename(const std::string& input, const std::string& outputDir, const CompileOptions& options)
+{
+	std::string name = input;
+	if(!outputDir.empty())
+	{
+		auto slash = name.find_last_of("/\\");
+		if(slash != std::string::npos) name = name.substr(slash + 1);
+
+		char last = outputDir.back();
+		name = (last == '/' || last == '\\') ? outputDir + name : outputDir + '/' + name;
+	}
+
+	auto dot = name.find_last_of('.');
+	auto slash = name.find_last_of("/\\");
+	if(dot != std::string::npos && (slash == std::string::npos || dot > slash)) name.erase(dot);
+
+	return name + (options.backend == Backend::C ? ".c" : ".s");
+}
+
+static void CompileItem(BatchItem& item, const CompileOptions& options, bool printStatistics)
+{
+	std::stringstream report;
+
+	std::ifstream file(item.input);
+	if(!file.is_open())
+	{
+		item.report = "Could not read " + item.input + '\n';
+		return;
+	}
+
+	std::stringstream source;
+	source << file.rdbuf();
+	file.close();
+
+	auto result = Compile(source.str(), options);
+	report << result.log << result.diagnostics;
+	if(printStatistics) report << StatisticsToString(result.statistics);
+
+	if(result.success)
+	{
+		std::ofstream output(item.output, std::ios::out | std::ios::trunc);
+		if(output.is_open())
+		{
+			output << result.assembly;
+			output.close();
+			item.success = true;
+		}
+		else report << "Could not write to " << item.output << '\n';
+	}
+
+	item.report = report.str();
+}
+
+int CompileBatch(const std::vector<std::string>& inputs, const std::string& outputDir, unsigned jobs, const CompileOptions& options, bool printStatistics)
+{
+	std::vector<BatchItem> items(inputs.size());
+	std::map<std::string, std::string> outputs;
+	bool collision = false;
+	for(size_t i = 0; i < inputs.size(); ++i)
+	{
+		items[i].input = inputs[i];
+		items[i].output = OutputFilename(inputs[i], outputDir, options);
+
+		// Inputs with the same name in different directories would overwrite each other's output
+		auto output = outputs.insert({ items[i].output, inputs[i] });
+		if(!output.second)
+		{
+			std::cout << inputs[i] << " and " << output.first->second << " would both be written to " << items[i].output << '\n';
+			collision = true;
+		}
+	}
+	if(collision) return -1;
+
+	std::atomic<size_t> next(0);
+	auto worker = [&]()
+	{
+		for(size_t i = next++; i < items.size(); i = next++) CompileItem(items[i], options, printStatistics);
+	};
+
+	if(jobs == 0) jobs = 1;
+	if(jobs > items.size()) jobs = (unsigned)items.size();
+
+	std::vector<std::thread> pool;
+	for(unsigned i = 1; i < jobs; ++i) pool.emplace_back(worker);
+	worker();
+	for(auto& thread : pool) thread.join();
+
+	size_t failed = 0;
+	for(const auto& item : items)
+	{
+		if(!item.success) failed++;
+		if(!item.report.empty() || !item.success)
+		{
+			std::cout << item.input << ": " << (item.success ? "ok" : "failed") << '\n' << item.report;
+		}
+	}
+
+	if(failed > 0)
+	{
+		std::cout << failed << " of " << items.size() << " files failed to compile\n";
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "compiler.h"
+
+
+// Compiles every input file with a pool of jobs threads pulling from a shared
+// work queue. Each result is written to outputDir (or next to its input when
+// outputDir is empty) with the extension replaced by ".s", or ".c" for the C
+// backend. Diagnostics are reported per file in input order, together with the
+// optimisation statistics if requested. Nothing is compiled when two inputs
+// would be written to the same file. Returns 0 when all files compiled.
+int CompileBatch(const std::vector<std::string>& inputs, const std::string& outputDir, unsigned jobs, const CompileOptions& options, bool printStatistics);
@@ -0,0 +1,466 @@
+#include <cmath>
+#include <cstdio>
+
+#include "c_generator.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+static std::string CType(Type type, bool array = false)
+{
+	std::string name;
+	switch(type)
+	{
+	case Type::Int: name = "int64_t"; break;
+	case Type::Float: name = "double"; break;
+	case Type::Bool: name = "int"; break;
+	default: name = "void"; break;
+	}
+
+	return array ? name + "*" : name;
+}
+
+static std::string COperator(Operator op)
+{
+	switch(op)
+	{
+	case Operator::Add: return "+";
+	case Operator::Subtract: case Operator::Negate: return "-";
+	case Operator::Multiply: return "*";
+	case Operator::Divide: return "/";
+	case Operator::Modulo: return "%";
+	case Operator::Equal: return "==";
+	case Operator::NotEqual: return "!=";
+	case Operator::Less: return "<";
+	case Operator::LessEqual: return "<=";
+	case Operator::More: return ">";
+	case Operator::MoreEqual: return ">=";
+	case Operator::And: return "&&";
+	case Operator::Or: return "||";
+	default: return "!";
+	}
+}
+
+static std::string CLiteral(std::shared_ptr<Literal> literal)
+{
+	char buffer[64];
+
+	if(literal->type == Type::Bool) return literal->boolValue ? "1" : "0";
+	if(literal->type == Type::Int)
+	{
+		std::snprintf(buffer, sizeof(buffer), literal->intValue < 0 ? "(%dLL)" : "%dLL", literal->intValue);
+		return buffer;
+	}
+
+	// civvm reads float constants in single precision and computes in double
+	double value = literal->floatValue;
+	if(std::isnan(value)) return "(0.0 / 0.0)";
+	if(std::isinf(value)) return value > 0 ? "(1.0 / 0.0)" : "(-1.0 / 0.0)";
+
+	std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+	std::string str = buffer;
+	if(str.find_first_of(".e") == std::string::npos) str += ".0";
+	return value < 0 ? "(" + str + ")" : str;
+}
+
+static std::string Indent(int indent)
+{
+	return std::string(indent, '\t');
+}
+
+static bool IsArrayDec(NodePtr dec)
+{
+	auto varDec = StaticCast<VarDec>(dec);
+	if(varDec) return varDec->var.array;
+
+	auto globalDef = StaticCast<GlobalDef>(dec);
+	return globalDef && globalDef->var.array;
+}
+
+// Whether the value of an operand can not change during the evaluation of its siblings
+static bool IsStable(NodePtr node)
+{
+	if(node->IsFamily<Literal>()) return true;
+
+	// Array references are never assigned after their allocation
+	auto id = StaticCast<Identifier>(node);
+	if(!id) return false;
+	if(IsArrayDec(id->dec)) return true;
+
+	auto funDef = StaticCast<FunctionDef>(id->dec);
+	if(!funDef) return false;
+	for(const auto& param : funDef->header.params) if(param.name == id->name) return !param.dim.empty();
+	return false;
+}
+
+std::string CGenerator::Generate(NodePtr root)
+{
+	static const char* keywords[] =
+	{
+		"auto", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+		"extern", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+		"short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void",
+		"volatile", "while", "_Bool", "_Complex", "_Imaginary", "int64_t", "frame", "up", "civic_alloc", "civic_main",
+	};
+	reserved.insert(std::begin(keywords), std::end(keywords));
+
+	std::vector<std::shared_ptr<FunctionDef>> functions;
+	TraverseBreadth(root, [&](NodePtr node, NodePtr parent)
+	{
+		auto funDef = StaticCast<FunctionDef>(node);
+		if(funDef)
+		{
+			functions.push_back(funDef);
+			reserved.insert(funDef->header.name);
+			if(parent->IsFamily<FunctionDef>())
+			{
+				owners[funDef] = parent;
+				framed.insert(parent);
+			}
+
+			TraverseNot<FunctionDef>(funDef, [&](NodePtr child, NodePtr)
+			{
+				owners[child] = funDef;
+			});
+		}
+
+		auto funDec = StaticCast<FunctionDec>(node);
+		if(funDec) reserved.insert(funDec->header.name);
+	});
+
+	std::stringstream sstream;
+	sstream << "#include <stdint.h>\n\n";
+	sstream << "void* civic_alloc(int64_t count, int64_t size);\n";
+
+	for(auto child : root->children)
+	{
+		auto funDec = StaticCast<FunctionDec>(child);
+		if(!funDec) continue;
+
+		sstream << CType(funDec->header.returnType) << ' ' << FunctionName(funDec->header.name) << '(';
+		for(size_t i = 0; i < funDec->header.params.size(); ++i)
+		{
+			const auto& param = funDec->header.params[i];
+			sstream << (i ? ", " : "") << CType(param.type, !param.dim.empty());
+		}
+		sstream << (funDec->header.params.empty() ? "void" : "") << ");\n";
+	}
+	sstream << '\n';
+
+	// Frame structs, in the order the functions were found, so that a parent is declared first
+	for(auto funDef : functions)
+	{
+		if(framed.count(funDef)) sstream << "struct frame_" << funDef->header.name << ";\n";
+	}
+	for(auto funDef : functions)
+	{
+		if(!framed.count(funDef)) continue;
+
+		std::stringstream members;
+		if(owners.count(funDef)) members << "\tstruct frame_" << StaticCast<FunctionDef>(owners[funDef])->header.name << "* up;\n";
+		for(const auto& param : funDef->header.params) members << '\t' << CType(param.type, !param.dim.empty()) << ' ' << Name(param.name) << ";\n";
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			auto varDec = StaticCast<VarDec>(node);
+			if(varDec) members << '\t' << CType(varDec->var.type, varDec->var.array) << ' ' << Name(varDec->var.name) << ";\n";
+		});
+
+		// ISO C has no empty structs
+		if(members.str().empty()) members << "\tchar unused_;\n";
+		sstream << "\nstruct frame_" << funDef->header.name << "\n{\n" << members.str() << "};\n";
+	}
+
+	for(auto child : root->children)
+	{
+		auto globalDef = StaticCast<GlobalDef>(child);
+		if(globalDef) sstream << "static " << CType(globalDef->var.type, globalDef->var.array) << ' ' << Name(globalDef->var.name) << ";\n";
+	}
+	sstream << '\n';
+
+	for(auto funDef : functions) sstream << Prototype(funDef) << ";\n";
+	for(auto funDef : functions) FunDef(funDef, sstream);
+
+	for(auto funDef : functions)
+	{
+		if(funDef->header.name != "main" || !funDef->exp) continue;
+
+		sstream << "\nint main(void)\n{\n";
+		if(funDef->header.returnType == Type::Void) sstream << "\tcivic_main();\n\treturn 0;\n";
+		else sstream << "\treturn (int)civic_main();\n";
+		sstream << "}\n";
+	}
+
+	return sstream.str();
+}
+
+std::string CGenerator::Name(const std::string& name) const
+{
+	return reserved.count(name) ? name + "_" : name;
+}
+
+std::string CGenerator::FunctionName(const std::string& name) const
+{
+	return name == "main" ? "civic_main" : name;
+}
+
+std::string CGenerator::Prototype(std::shared_ptr<FunctionDef> funDef) const
+{
+	std::stringstream sstream;
+
+	bool init = funDef->header.name == "__init";
+	if(!funDef->exp || init) sstream << "static ";
+	sstream << CType(funDef->header.returnType) << ' ' << FunctionName(funDef->header.name) << '(';
+
+	bool first = true;
+	if(owners.count(funDef))
+	{
+		sstream << "struct frame_" << StaticCast<FunctionDef>(owners.at(funDef))->header.name << "* up";
+		first = false;
+	}
+	for(const auto& param : funDef->header.params)
+	{
+		sstream << (first ? "" : ", ") << CType(param.type, !param.dim.empty()) << ' ' << Name(param.name);
+		first = false;
+	}
+	sstream << (first ? "void" : "") << ')';
+
+	if(init) sstream << " __attribute__((constructor))";
+	return sstream.str();
+}
+
+// Pointer to the frame struct of function, as seen from user, which is function or nested in it
+std::string CGenerator::FramePointer(NodePtr function, NodePtr user) const
+{
+	if(function == user) return "&frame";
+
+	std::string path = "up";
+	for(auto parent = owners.at(user); parent != function; parent = owners.at(parent)) path += "->up";
+	return path;
+}
+
+std::string CGenerator::Variable(NodePtr dec, const std::string& name, NodePtr user) const
+{
+	if(dec->IsFamily<GlobalDef>()) return Name(name);
+
+	auto owner = dec->IsFamily<FunctionDef>() ? dec : owners.at(dec);
+	if(owner == user) return framed.count(owner) ? "frame." + Name(name) : Name(name);
+
+	return FramePointer(owner, user) + "->" + Name(name);
+}
+
+void CGenerator::FunDef(std::shared_ptr<FunctionDef> funDef, std::stringstream& sstream)
+{
+	auto prototype = Prototype(funDef);
+	auto attribute = prototype.find(" __attribute__");
+	if(attribute != std::string::npos) prototype.erase(attribute);
+
+	sstream << '\n' << prototype << "\n{\n";
+
+	if(framed.count(funDef))
+	{
+		sstream << "\tstruct frame_" << funDef->header.name << " frame = { 0 };\n";
+		if(owners.count(funDef)) sstream << "\tframe.up = up;\n";
+		for(const auto& param : funDef->header.params) sstream << "\tframe." << Name(param.name) << " = " << Name(param.name) << ";\n";
+	}
+	else
+	{
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			auto varDec = StaticCast<VarDec>(node);
+			if(varDec) sstream << '\t' << CType(varDec->var.type, varDec->var.array) << ' ' << Name(varDec->var.name) << " = 0;\n";
+		});
+	}
+
+	std::stringstream body;
+	temporaries.clear();
+	for(auto child : funDef->children) Statement(child, funDef, 1, body);
+
+	for(const auto& temporary : temporaries) sstream << '\t' << CType(temporary.first) << ' ' << temporary.second << ";\n";
+	sstream << body.str() << "}\n";
+}
+
+void CGenerator::Statement(NodePtr node, NodePtr function, int indent, std::stringstream& sstream)
+{
+	auto alloc = StaticCast<AllocateArray>(node);
+	if(alloc) ArrayDec(alloc, function, indent, sstream);
+
+	auto assign = StaticCast<Assignment>(node);
+	if(assign)
+	{
+		sstream << Indent(indent) << Variable(assign->dec, assign->name, function) << " = ";
+		sstream << Expression(assign->children[0], function) << ";\n";
+	}
+
+	auto call = StaticCast<Call>(node);
+	if(call) sstream << Indent(indent) << FunCall(call, function) << ";\n";
+
+	auto ret = StaticCast<Return>(node);
+	if(ret)
+	{
+		if(ret->children.empty()) sstream << Indent(indent) << "return;\n";
+		else sstream << Indent(indent) << "return " << Expression(ret->children[0], function) << ";\n";
+	}
+
+	auto ifStatement = StaticCast<If>(node);
+	if(ifStatement)
+	{
+		auto elseStatement = StaticCast<Else>(ifStatement->children.back());
+		size_t end = ifStatement->children.size() - (elseStatement ? 1 : 0);
+
+		sstream << Indent(indent) << "if(" << Expression(ifStatement->children[0], function) << ")\n";
+		sstream << Indent(indent) << "{\n";
+		for(size_t i = 1; i < end; ++i) Statement(ifStatement->children[i], function, indent + 1, sstream);
+		sstream << Indent(indent) << "}\n";
+
+		if(elseStatement)
+		{
+			sstream << Indent(indent) << "else\n" << Indent(indent) << "{\n";
+			for(auto child : elseStatement->children) Statement(child, function, indent + 1, sstream);
+			sstream << Indent(indent) << "}\n";
+		}
+	}
+
+	auto doWhile = StaticCast<DoWhile>(node);
+	if(doWhile)
+	{
+		sstream << Indent(indent) << "do\n" << Indent(indent) << "{\n";
+		for(size_t i = 0; i + 1 < doWhile->children.size(); ++i) Statement(doWhile->children[i], function, indent + 1, sstream);
+		sstream << Indent(indent) << "} while(" << Expression(doWhile->children.back(), function) << ");\n";
+	}
+}
+
+void CGenerator::ArrayDec(std::shared_ptr<AllocateArray> alloc, NodePtr function, int indent, std::stringstream& sstream)
+{
+	auto array = Variable(alloc->dec, alloc->dec->IsFamily<GlobalDef>() ? StaticCast<GlobalDef>(alloc->dec)->var.name : StaticCast<VarDec>(alloc->dec)->var.name, function);
+	auto size = Expression(alloc->children[0], function);
+	auto type = CType(alloc->type);
+
+	std::string counter;
+	if(alloc->counter)
+	{
+		counter = Variable(alloc->counter, alloc->counter->var.name, function);
+		sstream << Indent(indent) << counter << " = " << size << ";\n";
+		size = counter;
+	}
+	sstream << Indent(indent) << array << " = civic_alloc(" << size << ", sizeof(" << type << "));\n";
+
+	if(alloc->children.size() < 2) return;
+	auto init = alloc->children[1];
+
+	if(init->IsFamily<ArrayExpr>())
+	{
+		for(size_t i = 0; i < init->children.size(); ++i)
+		{
+			sstream << Indent(indent) << array << '[' << i << "] = " << Expression(init->children[i], function) << ";\n";
+		}
+		return;
+	}
+
+	auto value = Expression(init, function);
+	if(alloc->value)
+	{
+		auto temp = Variable(alloc->value, alloc->value->var.name, function);
+		sstream << Indent(indent) << temp << " = " << value << ";\n";
+		value = temp;
+	}
+
+	if(!alloc->counter)
+	{
+		int count = StaticCast<Literal>(alloc->children[0])->intValue;
+		for(int i = 0; i < count; ++i) sstream << Indent(indent) << array << '[' << i << "] = " << value << ";\n";
+		return;
+	}
+	sstream << Indent(indent) << "while(" << counter << " > 0)\n" << Indent(indent) << "{\n";
+	sstream << Indent(indent + 1) << counter << "--;\n";
+	sstream << Indent(indent + 1) << array << '[' << counter << "] = " << value << ";\n";
+	sstream << Indent(indent) << "}\n";
+}
+
+std::string CGenerator::Expression(NodePtr node, NodePtr function)
+{
+	auto literal = StaticCast<Literal>(node);
+	if(literal) return CLiteral(literal);
+
+	auto id = StaticCast<Identifier>(node);
+	if(id) return Variable(id->dec, id->name, function);
+
+	auto call = StaticCast<Call>(node);
+	if(call) return FunCall(call, function);
+
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(binOp)
+	{
+		std::string sequence;
+		auto operands = Operands(binOp->children, function, sequence);
+		return "(" + sequence + operands[0] + " " + COperator(binOp->op) + " " + operands[1] + ")";
+	}
+
+	auto unOp = StaticCast<UnaryOp>(node);
+	if(unOp) return "(" + COperator(unOp->op) + Expression(unOp->children[0], function) + ")";
+
+	auto cast = StaticCast<Cast>(node);
+	if(cast)
+	{
+		if(cast->castFrom == cast->type) return Expression(cast->children[0], function);
+		return "((" + CType(cast->type) + ")" + Expression(cast->children[0], function) + ")";
+	}
+
+	auto ternary = StaticCast<Ternary>(node);
+	if(ternary)
+	{
+		return "(" + Expression(ternary->children[0], function) + " ? " + Expression(ternary->children[1], function) + " : " +
+			Expression(ternary->children[2], function) + ")";
+	}
+
+	return "0";
+}
+
+std::string CGenerator::FunCall(std::shared_ptr<Call> call, NodePtr function)
+{
+	std::string str = FunctionName(call->name) + "(";
+
+	bool first = true;
+	auto funDef = StaticCast<FunctionDef>(call->dec);
+	if(funDef && owners.count(funDef))
+	{
+		str += FramePointer(owners[funDef], function);
+		first = false;
+	}
+
+	std::string sequence;
+	auto operands = Operands(call->children, function, sequence);
+	for(const auto& operand : operands)
+	{
+		str += (first ? "" : ", ") + operand;
+		first = false;
+	}
+	str += ")";
+
+	return sequence.empty() ? str : "(" + sequence + str + ")";
+}
+
+// When a call is among the operands, every operand but the last that is not
+// stable is first stored in a temporary. The assignments are returned in
+// sequence, to be put in front of the expression with comma operators.
+std::vector<std::string> CGenerator::Operands(const std::vector<NodePtr>& operands, NodePtr function, std::string& sequence)
+{
+	bool hasCall = false;
+	for(auto operand : operands) hasCall |= Count<Call>(operand) > 0;
+
+	std::vector<std::string> exprs;
+	for(size_t i = 0; i < operands.size(); ++i)
+	{
+		exprs.push_back(Expression(operands[i], function));
+		if(!hasCall || i + 1 == operands.size() || IsStable(operands[i])) continue;
+
+		std::stringstream name;
+		name << "_e" << temporaryCounter++;
+		temporaries.push_back({ ExpressionType(operands[i]), name.str() });
+
+		sequence += name.str() + " = " + exprs.back() + ", ";
+		exprs.back() = name.str();
+	}
+
+	return exprs;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "node.h"
+
+
+// Generates C99 source from the lowered AST, to be compiled with runtime/civic_runtime.c.
+// CiviC ints become int64_t and floats double, matching civvm. Nested functions
+// become top-level static functions that take a pointer to the frame struct of
+// their enclosing function, which keeps the locals the nested functions can see.
+// Exported functions and externs keep their names and C linkage, the exported
+// main is renamed to civic_main behind a C main, and __init runs as a constructor.
+// C leaves the order of operands unspecified, so operands that a call could
+// observe or change are evaluated into temporaries first, in CiviC's order.
+class CGenerator
+{
+public:
+	std::string Generate(Nodes::NodePtr root);
+
+private:
+	// Enclosing function of every node inside a function, and of every nested function
+	std::map<Nodes::NodePtr, Nodes::NodePtr> owners;
+	// Functions with nested functions, which keep their locals in a frame struct
+	std::set<Nodes::NodePtr> framed;
+	std::set<std::string> reserved;
+	// Locals of the function being generated that hold operands evaluated ahead of a call
+	std::vector<std::pair<Nodes::Type, std::string>> temporaries;
+	int temporaryCounter = 0;
+
+	std::string Name(const std::string& name) const;
+	std::string FunctionName(const std::string& name) const;
+	std::string Prototype(std::shared_ptr<Nodes::FunctionDef> funDef) const;
+	std::string FramePointer(Nodes::NodePtr function, Nodes::NodePtr user) const;
+	std::string Variable(Nodes::NodePtr dec, const std::string& name, Nodes::NodePtr user) const;
+
+	void FunDef(std::shared_ptr<Nodes::FunctionDef> funDef, std::stringstream& sstream);
+	void Statement(Nodes::NodePtr node, Nodes::NodePtr function, int indent, std::stringstream& sstream);
+	void ArrayDec(std::shared_ptr<Nodes::AllocateArray> alloc, Nodes::NodePtr function, int indent, std::stringstream& sstream);
+	std::string Expression(Nodes::NodePtr node, Nodes::NodePtr function);
+	std::vector<std::string> Operands(const std::vector<Nodes::NodePtr>& operands, Nodes::NodePtr function, std::string& sequence);
+	std::string FunCall(std::shared_ptr<Nodes::Call> call, Nodes::NodePtr function);
+};
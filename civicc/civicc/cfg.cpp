@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+
+#include "cfg.h"
+
+
+static bool IsReturn(const AsmLine& line)
+{
+	const std::string suffix = "return";
+	const auto& text = line.text;
+
+	return line.kind == AsmLine::Instruction && text.size() >= suffix.size() &&
+		text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool IsJump(const AsmLine& line)
+{
+	return line.IsInstruction("jump") && line.args.size() == 1;
+}
+
+static bool IsBranch(const AsmLine& line)
+{
+	return (line.IsInstruction("branch_t") || line.IsInstruction("branch_f")) && line.args.size() == 1;
+}
+
+// Labels made by the generator for ifs, loops and ternaries start with a number
+static bool IsInternal(const std::string& label)
+{
+	return !label.empty() && std::isdigit((unsigned char)label[0]);
+}
+
+static bool FallsThrough(const BasicBlock& block)
+{
+	if(block.instructions.empty()) return true;
+
+	const auto& last = block.instructions.back();
+	return !IsJump(last) && !IsReturn(last);
+}
+
+// The label a block ends with a jump or branch to, or nullptr
+static std::string* Target(BasicBlock& block)
+{
+	if(block.instructions.empty()) return nullptr;
+
+	auto& last = block.instructions.back();
+	return IsJump(last) || IsBranch(last) ? &last.args[0] : nullptr;
+}
+
+static bool IsEntry(const BasicBlock& block)
+{
+	for(const auto& label : block.labels) if(!IsInternal(label)) return true;
+	return false;
+}
+
+static std::map<std::string, size_t> LabelIndex(const ControlFlowGraph& cfg)
+{
+	std::map<std::string, size_t> index;
+	for(size_t i = 0; i < cfg.size(); ++i) for(const auto& label : cfg[i].labels) index[label] = i;
+	return index;
+}
+
+static std::map<std::string, int> References(ControlFlowGraph& cfg)
+{
+	std::map<std::string, int> references;
+	for(auto& block : cfg)
+	{
+		auto target = Target(block);
+		if(target) references[*target]++;
+	}
+	return references;
+}
+
+ControlFlowGraph BuildControlFlowGraph(const Listing& code)
+{
+	ControlFlowGraph cfg(1);
+
+	for(const auto& line : code)
+	{
+		if(line.kind == AsmLine::Label)
+		{
+			if(!cfg.back().instructions.empty()) cfg.emplace_back();
+			cfg.back().labels.push_back(line.text);
+		}
+		else if(line.kind == AsmLine::Instruction)
+		{
+			cfg.back().instructions.push_back(line);
+			if(IsJump(line) || IsBranch(line) || IsReturn(line)) cfg.emplace_back();
+		}
+	}
+
+	if(cfg.back().labels.empty() && cfg.back().instructions.empty()) cfg.pop_back();
+	return cfg;
+}
+
+Listing ControlFlowGraphToListing(const ControlFlowGraph& cfg)
+{
+	Listing listing;
+
+	for(const auto& block : cfg)
+	{
+		for(const auto& label : block.labels)
+		{
+			AsmLine line;
+			line.kind = AsmLine::Label;
+			line.text = label;
+			listing.push_back(line);
+		}
+		listing.insert(listing.end(), block.instructions.begin(), block.instructions.end());
+	}
+
+	return listing;
+}
+
+struct CfgContext
+{
+	ControlFlowGraph& cfg;
+	std::map<std::string, size_t> index;
+	int freshLabel = 0;
+
+	CfgContext(ControlFlowGraph& cfg) : cfg(cfg) {}
+
+	std::string LabelOf(size_t block)
+	{
+		for(const auto& label : cfg[block].labels) if(IsInternal(label)) return label;
+
+		std::string label = std::to_string(freshLabel++) + "_block";
+		cfg[block].labels.push_back(label);
+		index[label] = block;
+		return label;
+	}
+};
+
+// The block that branches on the constant a block ends with, or -1. A block
+// ending in "bloadc_t" falls into it, one ending in "bloadc_t; jump L" jumps to it.
+static int ConstantBranch(CfgContext& context, size_t i, bool& value)
+{
+	const auto& instructions = context.cfg[i].instructions;
+	size_t size = instructions.size();
+	if(size == 0) return -1;
+
+	bool jumps = IsJump(instructions.back());
+	if(jumps && size < 2) return -1;
+
+	const auto& constant = instructions[jumps ? size - 2 : size - 1];
+	value = constant.IsInstruction("bloadc_t");
+	if(!value && !constant.IsInstruction("bloadc_f")) return -1;
+
+	size_t u = i + 1;
+	if(jumps)
+	{
+		auto it = context.index.find(instructions.back().args[0]);
+		if(it == context.index.end()) return -1;
+		u = it->second;
+	}
+
+	if(u + 1 >= context.cfg.size()) return -1;
+	const auto& branch = context.cfg[u].instructions;
+	return branch.size() == 1 && IsBranch(branch[0]) ? (int)u : -1;
+}
+
+// Where control continues after the constant branch in block u
+static std::string BranchDestination(CfgContext& context, size_t u, bool value)
+{
+	const auto& branch = context.cfg[u].instructions[0];
+	bool taken = value == branch.IsInstruction("branch_t");
+	return taken ? branch.args[0] : context.LabelOf(u + 1);
+}
+
+// Where control ends up after jumping to the label, skipping blocks that
+// only jump on, or that push a constant which is branched on right away
+static std::string ThreadTarget(CfgContext& context, std::string label)
+{
+	const int maxHops = 8;
+
+	for(int hop = 0; hop < maxHops; ++hop)
+	{
+		auto it = context.index.find(label);
+		if(it == context.index.end()) break;
+
+		size_t i = it->second;
+		const auto& block = context.cfg[i];
+
+		if(block.instructions.size() == 1 && IsJump(block.instructions[0]))
+		{
+			label = block.instructions[0].args[0];
+			continue;
+		}
+
+		bool value;
+		int u = ConstantBranch(context, i, value);
+		if(u < 0 || block.instructions.size() > 2 || (block.instructions.size() == 2 && !IsJump(block.instructions[1]))) break;
+
+		label = BranchDestination(context, u, value);
+	}
+
+	return label;
+}
+
+// Blocks that push a constant only to branch on it jump to the destination instead
+static int ThreadConstants(CfgContext& context)
+{
+	int threaded = 0;
+
+	for(size_t i = 0; i < context.cfg.size(); ++i)
+	{
+		bool value;
+		int u = ConstantBranch(context, i, value);
+		if(u < 0) continue;
+
+		auto destination = BranchDestination(context, u, value);
+		auto& instructions = context.cfg[i].instructions;
+		if(IsJump(instructions.back())) instructions.pop_back();
+
+		instructions.back().text = "jump";
+		instructions.back().args = { destination };
+		threaded++;
+	}
+
+	return threaded;
+}
+
+static int ThreadJumps(CfgContext& context)
+{
+	int threaded = 0;
+
+	for(auto& block : context.cfg)
+	{
+		auto target = Target(block);
+		if(!target) continue;
+
+		auto label = ThreadTarget(context, *target);
+		if(label == *target) continue;
+
+		*target = label;
+		threaded++;
+	}
+
+	return threaded;
+}
+
+// branch_f L; jump M; L: -> branch_t M; L:
+static int InvertBranches(CfgContext& context)
+{
+	auto& cfg = context.cfg;
+	auto references = References(cfg);
+	int inverted = 0;
+
+	for(size_t i = 0; i + 2 < cfg.size(); ++i)
+	{
+		auto& branch = cfg[i];
+		const auto& jump = cfg[i + 1];
+		if(branch.instructions.empty() || !IsBranch(branch.instructions.back())) continue;
+		if(jump.instructions.size() != 1 || !IsJump(jump.instructions[0])) continue;
+
+		bool enteredElsewhere = false;
+		for(const auto& label : jump.labels) if(!IsInternal(label) || references[label]) enteredElsewhere = true;
+		if(enteredElsewhere) continue;
+
+		const auto& after = cfg[i + 2].labels;
+		auto& last = branch.instructions.back();
+		if(std::find(after.begin(), after.end(), last.args[0]) == after.end()) continue;
+
+		last.text = last.IsInstruction("branch_t") ? "branch_f" : "branch_t";
+		last.args[0] = jump.instructions[0].args[0];
+		cfg.erase(cfg.begin() + i + 1);
+		inverted++;
+	}
+
+	if(inverted) context.index = LabelIndex(cfg);
+	return inverted;
+}
+
+// Moves a block that is entered by a jump, but not by falling into it, directly
+// after the jump so the jump disappears. Only blocks that do not fall through
+// themselves can be moved without adding a jump.
+static int MoveJumpTargets(CfgContext& context)
+{
+	auto& cfg = context.cfg;
+	int moved = 0;
+
+	for(size_t i = 0; i < cfg.size(); ++i)
+	{
+		auto& block = cfg[i];
+		if(block.instructions.empty() || !IsJump(block.instructions.back())) continue;
+
+		auto it = context.index.find(block.instructions.back().args[0]);
+		if(it == context.index.end()) continue;
+
+		size_t t = it->second;
+		if(t == i || t == i + 1 || IsEntry(cfg[t]) || FallsThrough(cfg[t])) continue;
+		if(t > 0 && FallsThrough(cfg[t - 1])) continue;
+
+		auto target = cfg[t];
+		block.instructions.pop_back();
+		cfg.erase(cfg.begin() + t);
+		cfg.insert(cfg.begin() + (t < i ? i : i + 1), target);
+
+		context.index = LabelIndex(cfg);
+		moved++;
+		if(t < i) --i;
+	}
+
+	return moved;
+}
+
+static int RemoveUnreachable(CfgContext& context)
+{
+	auto& cfg = context.cfg;
+	std::vector<bool> reachable(cfg.size(), false);
+	std::vector<size_t> work;
+
+	for(size_t i = 0; i < cfg.size(); ++i)
+	{
+		if(i == 0 || IsEntry(cfg[i])) work.push_back(i);
+	}
+
+	while(!work.empty())
+	{
+		size_t i = work.back();
+		work.pop_back();
+		if(reachable[i]) continue;
+		reachable[i] = true;
+
+		if(FallsThrough(cfg[i]) && i + 1 < cfg.size()) work.push_back(i + 1);
+
+		auto target = Target(cfg[i]);
+		auto it = target ? context.index.find(*target) : context.index.end();
+		if(it != context.index.end()) work.push_back(it->second);
+	}
+
+	int removed = 0;
+	ControlFlowGraph kept;
+	for(size_t i = 0; i < cfg.size(); ++i)
+	{
+		if(reachable[i]) kept.push_back(cfg[i]);
+		else removed++;
+	}
+
+	if(removed)
+	{
+		cfg.swap(kept);
+		context.index = LabelIndex(cfg);
+	}
+	return removed;
+}
+
+// Drops jumps to the next block and labels nobody jumps to, which merges a
+// block into the one falling into it
+static int MergeBlocks(ControlFlowGraph& cfg)
+{
+	for(size_t i = 0; i + 1 < cfg.size(); ++i)
+	{
+		auto target = Target(cfg[i]);
+		if(!target || !IsJump(cfg[i].instructions.back())) continue;
+
+		const auto& next = cfg[i + 1].labels;
+		if(std::find(next.begin(), next.end(), *target) != next.end()) cfg[i].instructions.pop_back();
+	}
+
+	auto references = References(cfg);
+	int merged = 0;
+
+	for(size_t i = 0; i < cfg.size(); ++i)
+	{
+		auto& labels = cfg[i].labels;
+		if(labels.empty()) continue;
+
+		labels.erase(std::remove_if(labels.begin(), labels.end(), [&](const std::string& label)
+		{
+			return IsInternal(label) && !references[label];
+		}), labels.end());
+
+		if(labels.empty() && i > 0 && FallsThrough(cfg[i - 1])) merged++;
+	}
+
+	return merged;
+}
+
+void OptimiseControlFlow(Listing& listing, Statistics& statistics)
+{
+	// Functions come first, the directives after them are left as they are
+	size_t end = 0;
+	while(end < listing.size() && (listing[end].kind == AsmLine::Label || listing[end].kind == AsmLine::Instruction)) end++;
+
+	Listing code(listing.begin(), listing.begin() + end);
+	auto cfg = BuildControlFlowGraph(code);
+
+	CfgContext context(cfg);
+	context.index = LabelIndex(cfg);
+	for(const auto& pair : context.index)
+	{
+		if(IsInternal(pair.first)) context.freshLabel = std::max(context.freshLabel, std::atoi(pair.first.c_str()) + 1);
+	}
+
+	bool changed = true;
+	while(changed)
+	{
+		int threaded = ThreadJumps(context) + ThreadConstants(context);
+		int inverted = InvertBranches(context);
+		int moved = MoveJumpTargets(context);
+		int removed = RemoveUnreachable(context);
+
+		statistics["cfg.threaded_jumps"] += threaded;
+		statistics["cfg.inverted_branches"] += inverted;
+		statistics["cfg.moved_blocks"] += moved;
+		statistics["cfg.unreachable_blocks"] += removed;
+		changed = threaded + inverted + moved + removed > 0;
+	}
+	statistics["cfg.merged_blocks"] += MergeBlocks(cfg);
+
+	code = ControlFlowGraphToListing(cfg);
+	statistics["cfg.instructions_before"] += CountInstructions(Listing(listing.begin(), listing.begin() + end));
+	statistics["cfg.instructions_after"] += CountInstructions(code);
+
+	code.insert(code.end(), listing.begin() + end, listing.end());
+	listing.swap(code);
+}
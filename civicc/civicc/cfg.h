@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "listing.h"
+#include "statistics.h"
+
+
+// A run of instructions that is only entered at the top and only left at the
+// bottom. The last instruction is the only jump, branch or return.
+struct BasicBlock
+{
+	std::vector<std::string> labels;
+	std::vector<AsmLine> instructions;
+};
+
+// The blocks of a listing in layout order. A block without a jump or return
+// at its end falls through into the next one.
+typedef std::vector<BasicBlock> ControlFlowGraph;
+
+ControlFlowGraph BuildControlFlowGraph(const Listing& code);
+Listing ControlFlowGraphToListing(const ControlFlowGraph& cfg);
+
+// Threads jumps through blocks that only pass control on, turns branches
+// around jumps into a single inverted branch, moves jump targets after their
+// jump, removes unreachable blocks and merges blocks that follow each other.
+// Only the generator's numbered labels are touched, so function and tail call
+// entries stay in place. The instruction counts before and after are counted
+// under "cfg.instructions_before" and "cfg.instructions_after".
+void OptimiseControlFlow(Listing& listing, Statistics& statistics);
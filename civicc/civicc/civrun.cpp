@@ -0,0 +1,62 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+#include "interpreter.h"
+#include "profile.h"
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> modules;
+	bool cycles = false;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		if(strcmp(argv[i], "--cycles") == 0) cycles = true;
+		else if(strcmp(argv[i], "--help") == 0)
+		{
+			std::cout << "civrun [--cycles] <file>...\n";
+			return 0;
+		}
+		else
+		{
+			std::ifstream file(argv[i]);
+			if(!file.is_open())
+			{
+				std::cerr << "Could not read " << argv[i] << '\n';
+				return -1;
+			}
+
+			std::stringstream assembly;
+			assembly << file.rdbuf();
+			modules.push_back(assembly.str());
+		}
+	}
+
+	if(modules.empty())
+	{
+		std::cerr << "No input file supplied.\n";
+		return -1;
+	}
+
+	auto result = RunAssembly(modules);
+	if(!result.success)
+	{
+		std::cerr << result.error << '\n';
+		return -1;
+	}
+
+	if(cycles) std::cerr << "Instructions executed: " << result.instructions << '\n';
+
+	// Same place as the runtime of the C and native backends writes it
+	if(!result.profile.empty())
+	{
+		const char* profileFilename = std::getenv("CIVIC_PROFILE");
+		std::ofstream profile(profileFilename ? profileFilename : "civic.prof", std::ios::out | std::ios::trunc);
+		WriteProfile(profile, result.profile);
+	}
+	return (int)result.exitValue;
+}
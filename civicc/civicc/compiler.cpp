@@ -0,0 +1,255 @@
+#include <vector>
+#include <cstdlib>
+
+#include "compiler.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "traverse.h"
+#include "seperation.h"
+#include "replace_boolops.h"
+#include "analysis.h"
+#include "assembly.h"
+#include "nested_func_renaming.h"
+#include "replace_loops.h"
+#include "global_getset.h"
+#include "global_promotion.h"
+#include "listing.h"
+#include "peephole.h"
+#include "cfg.h"
+#include "constant_folding.h"
+#include "dead_code.h"
+#include "inliner.h"
+#include "tail_calls.h"
+#include "value_numbering.h"
+#include "lambda_lifting.h"
+#include "linker.h"
+#include "loop_invariants.h"
+#include "loop_unrolling.h"
+#include "simplifier.h"
+#include "array_lowering.h"
+#include "c_generator.h"
+#include "native_generator.h"
+#include "profile.h"
+#include "pure_calls.h"
+#include "specialisation.h"
+
+using namespace Nodes;
+
+
+CompileContext::CompileContext(const CompileOptions& options) :
+	options(options)
+{
+}
+
+CompileResult CompileContext::Compile(const std::string& source)
+{
+	CompileResult result;
+
+	try
+	{
+		auto root = Parse(source);
+		if(root && Analyse(root)) Generate(root, result);
+	}
+	catch(ParseException e)
+	{
+		diagnostics << e.what();
+	}
+
+	result.diagnostics = diagnostics.str();
+	result.log = log.str();
+	result.statistics = statistics;
+	return result;
+}
+
+CompileResult CompileContext::CompileProgram(const std::vector<ModuleSource>& modules)
+{
+	CompileResult result;
+	std::vector<NodePtr> roots;
+
+	for(const auto& module : modules)
+	{
+		bool analysed = false;
+		try
+		{
+			auto root = Parse(module.source);
+			analysed = root && Analyse(root);
+			if(analysed) roots.push_back(root);
+		}
+		catch(ParseException e)
+		{
+			diagnostics << e.what();
+		}
+
+		if(!analysed) diagnostics << "Could not compile " << module.name << "\n";
+	}
+
+	if(roots.size() == modules.size())
+	{
+		auto root = std::make_shared<Root>();
+		if(LinkModules(roots, root, diagnostics, statistics)) Generate(root, result);
+	}
+
+	result.diagnostics = diagnostics.str();
+	result.log = log.str();
+	result.statistics = statistics;
+	return result;
+}
+
+void CompileContext::Generate(NodePtr root, CompileResult& result)
+{
+	Lower(root);
+
+	if(options.backend == Backend::C) result.assembly = CGenerator().Generate(root);
+	else if(options.backend == Backend::Native) result.assembly = NativeGenerator().Generate(root);
+	else
+	{
+		AssemblyGenerator assemblyGenerator(options.optimisationLevel >= 1, statistics);
+		result.assembly = Optimise(assemblyGenerator.Generate(root));
+	}
+	result.success = true;
+
+	if(options.verbose)
+	{
+		log << "AST after:\n" << TreeToJSON(root) << "\n";
+		log << "-------------------------------------\n";
+		log << "Assembly\n";
+		log << "-------------------------------------\n";
+		log << result.assembly << "\n";
+	}
+}
+
+NodePtr CompileContext::Parse(const std::string& source)
+{
+	std::istringstream istream(source);
+	Tokenizer tokenizer(istream);
+	Token token;
+	std::vector<Token> tokens;
+
+	try{ while(tokenizer.GetNextToken(token)) tokens.push_back(token); }
+	catch(int line)
+	{
+		diagnostics << "Integer value out of range at line " << line << "\n";
+		return nullptr;
+	}
+
+	auto root = std::make_shared<Root>();
+	Parser(tokens).ParseProgram(root);
+	return root;
+}
+
+bool CompileContext::Analyse(NodePtr root)
+{
+	SeperateDecAndInit(root);
+	if(options.verbose) log << "AST before:\n" << TreeToJSON(root) << "\n";
+
+	auto errors = Analyzer().Analyse(root);
+	diagnostics << errors;
+	return errors.empty();
+}
+
+void CompileContext::Lower(NodePtr root)
+{
+	LowerArrays(root, statistics);
+	ReplaceBooleanOperators(root);
+
+	// Profile points are numbered before any pass that depends on the optimisation
+	// level changes the tree, so a profile recorded at one level applies at another
+	if(options.instrument) InstrumentProgram(root, statistics);
+	if(!options.profile.empty()) ApplyProfile(root, options.profile, diagnostics);
+
+	if(options.optimisationLevel >= 1) UnrollLoops(root, options.unrollFactor, statistics);
+	ReplaceLoops(root);
+	RenameNestedFunctions(root);
+	if(options.optimisationLevel >= 1) PromoteGlobals(root, statistics);
+	CreateGettersSetters(root);
+
+	if(options.optimisationLevel >= 1)
+	{
+		LayoutBranches(root, statistics);
+		LiftNestedFunctions(root, statistics);
+		InlineFunctions(root, InlineThreshold(options.optimisationLevel), statistics);
+		SpecialiseFunctions(root, options.specialisationGrowth, statistics);
+		FoldConstants(root, statistics);
+		if(EvaluatePureCalls(root, options.evaluationBudget, statistics)) FoldConstants(root, statistics);
+		SimplifyExpressions(root, statistics);
+		HoistLoopInvariants(root, statistics);
+		EliminateDeadCode(root, statistics);
+		NumberValues(root, statistics);
+		MarkTailCalls(root, diagnostics, statistics);
+	}
+}
+
+std::string CompileContext::Optimise(const std::string& assembly)
+{
+	if(options.optimisationLevel < 1) return assembly;
+
+	// The peephole rules clean up what the control flow passes expose and the other way around
+	auto listing = ParseListing(assembly);
+	Peephole(listing, statistics);
+	OptimiseControlFlow(listing, statistics);
+	Peephole(listing, statistics);
+	return ListingToString(listing);
+}
+
+CompileResult Compile(const std::string& source, const CompileOptions& options)
+{
+	return CompileContext(options).Compile(source);
+}
+
+CompileResult CompileProgram(const std::vector<ModuleSource>& modules, const CompileOptions& options)
+{
+	return CompileContext(options).CompileProgram(modules);
+}
+
+std::string OptionsToString(const CompileOptions& options)
+{
+	std::stringstream sstream;
+	sstream << "v=" << options.verbose << " O=" << options.optimisationLevel << " b=" << (int)options.backend;
+	sstream << " i=" << options.instrument;
+	sstream << " es=" << options.evaluationBudget.steps << " ed=" << options.evaluationBudget.depth;
+	sstream << " sg=" << options.specialisationGrowth << " uf=" << options.unrollFactor;
+
+	if(!options.profile.empty())
+	{
+		sstream << " p=";
+		for(const auto& point : options.profile) sstream << point.first << ':' << point.second << ',';
+	}
+	return sstream.str();
+}
+
+CompileOptions OptionsFromString(const std::string& str)
+{
+	CompileOptions options;
+	std::stringstream sstream(str);
+	std::string option;
+
+	while(sstream >> option)
+	{
+		auto split = option.find('=');
+		if(split == std::string::npos) continue;
+
+		std::string name = option.substr(0, split);
+		if(name == "p")
+		{
+			std::stringstream points(option.substr(split + 1));
+			int id;
+			long long count;
+			char colon, comma;
+			while(points >> id >> colon >> count >> comma) options.profile[id] = count;
+			continue;
+		}
+
+		int value = std::atoi(option.c_str() + split + 1);
+
+		if(name == "v") options.verbose = value != 0;
+		else if(name == "O") options.optimisationLevel = value;
+		else if(name == "b") options.backend = (Backend)value;
+		else if(name == "i") options.instrument = value != 0;
+		else if(name == "es") options.evaluationBudget.steps = value;
+		else if(name == "ed") options.evaluationBudget.depth = value;
+		else if(name == "sg") options.specialisationGrowth = value;
+		else if(name == "uf") options.unrollFactor = value;
+	}
+
+	return options;
+}
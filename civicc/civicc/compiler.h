@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "node.h"
+#include "profile.h"
+#include "pure_calls.h"
+#include "statistics.h"
+
+
+enum class Backend
+{
+	Assembly,
+	// C source, see c_generator.h
+	C,
+	// x86-64 GNU as assembly, see native_generator.h
+	Native
+};
+
+struct CompileOptions
+{
+	bool verbose = false;
+	// 0 disables all optimisations
+	int optimisationLevel = 1;
+	Backend backend = Backend::Assembly;
+	// Count executions of the profile points, see profile.h
+	bool instrument = false;
+	// Guides inlining and branch layout when not empty
+	Profile profile;
+	EvaluationBudget evaluationBudget;
+	// Percentage the function specialisation may grow the program by
+	int specialisationGrowth = 20;
+	// Copies of the body per iteration of partially unrolled loops, see loop_unrolling.h
+	int unrollFactor = 4;
+};
+
+struct CompileResult
+{
+	bool success = false;
+	// Output of the selected backend
+	std::string assembly;
+	// Errors reported by the tokenizer, parser and analyzer
+	std::string diagnostics;
+	// AST dumps and the generated assembly, only filled in verbose mode
+	std::string log;
+	Statistics statistics;
+};
+
+// A module of a whole program, the name is only used in diagnostics
+struct ModuleSource
+{
+	std::string name;
+	std::string source;
+};
+
+// Holds everything that lives for the duration of a single compilation. The
+// compiler has no mutable global state, so separate contexts can be used
+// concurrently from different threads.
+class CompileContext
+{
+public:
+	CompileContext(const CompileOptions& options);
+
+	CompileResult Compile(const std::string& source);
+	// Compiles the modules into one, see linker.h
+	CompileResult CompileProgram(const std::vector<ModuleSource>& modules);
+
+private:
+	CompileOptions options;
+	std::stringstream diagnostics, log;
+	Statistics statistics;
+
+	Nodes::NodePtr Parse(const std::string& source);
+	bool Analyse(Nodes::NodePtr root);
+	void Lower(Nodes::NodePtr root);
+	void Generate(Nodes::NodePtr root, CompileResult& result);
+	std::string Optimise(const std::string& assembly);
+};
+
+CompileResult Compile(const std::string& source, const CompileOptions& options);
+CompileResult CompileProgram(const std::vector<ModuleSource>& modules, const CompileOptions& options);
+
+// Flat text form of the options, used to key caches and to send them to a server
+std::string OptionsToString(const CompileOptions& options);
+CompileOptions OptionsFromString(const std::string& str);
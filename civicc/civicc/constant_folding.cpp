@@ -0,0 +1,245 @@
+#include <cmath>
+#include <limits>
+#include <map>
+#include <set>
+
+#include "constant_folding.h"
+#include "assembly.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+NodePtr FoldInt(Operator op, int a, int b)
+{
+	int64_t x = a, y = b, result;
+
+	switch(op)
+	{
+	case Operator::Add: result = x + y; break;
+	case Operator::Subtract: result = x - y; break;
+	case Operator::Multiply: result = x * y; break;
+	case Operator::Divide:
+	case Operator::Modulo:
+		// Leave the division by zero to the VM
+		if(b == 0) return nullptr;
+		result = op == Operator::Divide ? x / y : x % y;
+		break;
+	case Operator::Equal: return std::make_shared<Literal>(a == b);
+	case Operator::NotEqual: return std::make_shared<Literal>(a != b);
+	case Operator::Less: return std::make_shared<Literal>(a < b);
+	case Operator::LessEqual: return std::make_shared<Literal>(a <= b);
+	case Operator::More: return std::make_shared<Literal>(a > b);
+	case Operator::MoreEqual: return std::make_shared<Literal>(a >= b);
+	default: return nullptr;
+	}
+
+	// The VM does not wrap around at 32 bits, so results that do not fit a
+	// literal are left to be computed at runtime
+	if(result < std::numeric_limits<int>::min() || result > std::numeric_limits<int>::max()) return nullptr;
+	return std::make_shared<Literal>((int)result);
+}
+
+// The VM computes floats in double precision, so the result is only folded
+// when single precision literals can hold it exactly
+NodePtr FoldFloat(Operator op, double a, double b)
+{
+	double result;
+
+	switch(op)
+	{
+	case Operator::Add: result = a + b; break;
+	case Operator::Subtract: result = a - b; break;
+	case Operator::Multiply: result = a * b; break;
+	case Operator::Divide: result = a / b; break;
+	case Operator::Equal: return std::make_shared<Literal>(a == b);
+	case Operator::NotEqual: return std::make_shared<Literal>(a != b);
+	case Operator::Less: return std::make_shared<Literal>(a < b);
+	case Operator::LessEqual: return std::make_shared<Literal>(a <= b);
+	case Operator::More: return std::make_shared<Literal>(a > b);
+	case Operator::MoreEqual: return std::make_shared<Literal>(a >= b);
+	default: return nullptr;
+	}
+
+	// Infinities and NaN have no representation in the constant pool
+	if(!std::isfinite(result) || (double)(float)result != result) return nullptr;
+	return std::make_shared<Literal>((float)result);
+}
+
+NodePtr FoldBinaryOp(std::shared_ptr<BinaryOp> binOp)
+{
+	auto left = StaticCast<Literal>(binOp->children[0]);
+	auto right = StaticCast<Literal>(binOp->children[1]);
+	if(!left || !right || left->type != right->type) return nullptr;
+
+	if(left->type == Type::Int) return FoldInt(binOp->op, left->intValue, right->intValue);
+	if(left->type == Type::Float) return FoldFloat(binOp->op, left->floatValue, right->floatValue);
+
+	if(binOp->op == Operator::Equal) return std::make_shared<Literal>(left->boolValue == right->boolValue);
+	if(binOp->op == Operator::NotEqual) return std::make_shared<Literal>(left->boolValue != right->boolValue);
+	return nullptr;
+}
+
+NodePtr FoldUnaryOp(std::shared_ptr<UnaryOp> unOp)
+{
+	auto literal = StaticCast<Literal>(unOp->children[0]);
+	if(!literal) return nullptr;
+
+	if(unOp->op == Operator::Not && literal->type == Type::Bool) return std::make_shared<Literal>(!literal->boolValue);
+	if(unOp->op == Operator::Negate)
+	{
+		if(literal->type == Type::Int && literal->intValue != std::numeric_limits<int>::min())
+		{
+			return std::make_shared<Literal>(-literal->intValue);
+		}
+		if(literal->type == Type::Float) return std::make_shared<Literal>(-literal->floatValue);
+	}
+
+	return nullptr;
+}
+
+NodePtr FoldCast(std::shared_ptr<Cast> cast)
+{
+	auto literal = StaticCast<Literal>(cast->children[0]);
+	if(!literal) return nullptr;
+
+	if(literal->type == cast->type) return std::make_shared<Literal>(*literal);
+	if(literal->type == Type::Int && cast->type == Type::Float)
+	{
+		// Above 2^24 not every int has an exact single precision literal
+		if((double)(float)literal->intValue != (double)literal->intValue) return nullptr;
+		return std::make_shared<Literal>((float)literal->intValue);
+	}
+	if(literal->type == Type::Float && cast->type == Type::Int)
+	{
+		// Out of range conversions are undefined, leave those to the VM
+		if(literal->floatValue >= -2147483648.0f && literal->floatValue < 2147483648.0f)
+		{
+			return std::make_shared<Literal>((int)literal->floatValue);
+		}
+	}
+
+	return nullptr;
+}
+
+NodePtr FoldTernary(std::shared_ptr<Ternary> ternary)
+{
+	auto condition = StaticCast<Literal>(ternary->children[0]);
+	if(!condition) return nullptr;
+
+	return condition->boolValue ? ternary->children[1] : ternary->children[2];
+}
+
+void Fold(NodePtr& node, int& removed)
+{
+	for(auto& child : node->children) Fold(child, removed);
+
+	NodePtr folded = nullptr;
+
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(binOp) folded = FoldBinaryOp(binOp);
+
+	auto unOp = StaticCast<UnaryOp>(node);
+	if(unOp) folded = FoldUnaryOp(unOp);
+
+	auto cast = StaticCast<Cast>(node);
+	if(cast) folded = FoldCast(cast);
+
+	auto ternary = StaticCast<Ternary>(node);
+	if(ternary) folded = FoldTernary(ternary);
+
+	if(folded)
+	{
+		removed += InstructionCount(node) - InstructionCount(folded);
+		if(folded->IsFamily<Literal>())
+		{
+			folded->pos = node->pos;
+			folded->line = node->line;
+		}
+		node = folded;
+	}
+}
+
+void ReplaceIdentifiers(NodePtr node, const std::map<NodePtr, std::shared_ptr<Literal>>& constants)
+{
+	for(auto& child : node->children)
+	{
+		auto id = StaticCast<Identifier>(child);
+		auto it = id ? constants.find(id->dec) : constants.end();
+
+		if(it != constants.end())
+		{
+			auto literal = std::make_shared<Literal>(*it->second);
+			literal->pos = id->pos;
+			literal->line = id->line;
+			child = literal;
+		}
+		else ReplaceIdentifiers(child, constants);
+	}
+}
+
+// Replaces locals that are assigned a literal exactly once by that literal.
+// Reading a local before its assignment is undefined, so the position of the
+// assignment does not matter. Locals accessed from nested functions are left
+// alone. Returns whether anything was propagated.
+bool Propagate(NodePtr root, int& removed)
+{
+	std::map<NodePtr, NodePtr> owner;
+	std::map<NodePtr, std::vector<std::shared_ptr<Assignment>>> assignments;
+	std::set<NodePtr> captured;
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			owner[node] = funDef;
+		});
+	});
+
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		auto id = StaticCast<Identifier>(node);
+		if(id && id->dec && owner[id] != owner[id->dec]) captured.insert(id->dec);
+
+		auto assign = StaticCast<Assignment>(node);
+		if(assign && assign->dec)
+		{
+			assignments[assign->dec].push_back(assign);
+			if(owner[assign] != owner[assign->dec]) captured.insert(assign->dec);
+		}
+	});
+
+	std::map<NodePtr, std::shared_ptr<Literal>> constants;
+	std::set<NodePtr> dead;
+
+	for(const auto& pair : assignments)
+	{
+		auto varDec = StaticCast<VarDec>(pair.first);
+		if(!varDec || varDec->var.array || captured.count(varDec) || pair.second.size() != 1) continue;
+
+		auto assign = pair.second.front();
+		auto literal = assign->children.size() == 1 ? StaticCast<Literal>(assign->children[0]) : nullptr;
+		if(!literal) continue;
+
+		constants[varDec] = literal;
+		dead.insert(varDec);
+		dead.insert(assign);
+		removed += InstructionCount(literal) + 1;
+	}
+
+	if(constants.empty()) return false;
+
+	ReplaceIdentifiers(root, constants);
+	Remove(root, dead);
+	return true;
+}
+
+void FoldConstants(NodePtr root, Statistics& statistics)
+{
+	int removed = 0;
+
+	do Fold(root, removed);
+	while(Propagate(root, removed));
+
+	statistics["constant_folding.instructions_removed"] += removed;
+}
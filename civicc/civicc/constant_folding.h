@@ -0,0 +1,14 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Evaluates operators, casts and ternaries on literals and propagates locals
+// that are assigned a literal exactly once, until nothing changes anymore.
+// The estimated number of removed instructions is counted under
+// "constant_folding.instructions_removed".
+void FoldConstants(Nodes::NodePtr root, Statistics& statistics);
+
+// Evaluates an operator on two literals, or returns nullptr when it can not be done at compile time
+Nodes::NodePtr FoldBinaryOp(std::shared_ptr<Nodes::BinaryOp> binOp);
@@ -0,0 +1,133 @@
+#include <map>
+#include <set>
+
+#include "dead_code.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+// Splices the taken branch of an if with a literal condition into the
+// enclosing block, unrolls do-while loops whose condition is literal false and
+// drops the statements following a return.
+void PruneStatements(NodePtr node, int& statements)
+{
+	for(auto child : node->children) PruneStatements(child, statements);
+
+	std::vector<NodePtr> list;
+	for(auto child : node->children)
+	{
+		if(!list.empty() && list.back()->IsFamily<Return>())
+		{
+			statements++;
+			continue;
+		}
+
+		auto ifStatement = StaticCast<If>(child);
+		auto condition = ifStatement ? StaticCast<Literal>(ifStatement->children[0]) : nullptr;
+		if(condition)
+		{
+			auto elseStatement = StaticCast<Else>(ifStatement->children.back());
+			auto end = ifStatement->children.end() - (elseStatement ? 1 : 0);
+
+			if(condition->boolValue) list.insert(list.end(), ifStatement->children.begin() + 1, end);
+			else if(elseStatement) list.insert(list.end(), elseStatement->children.begin(), elseStatement->children.end());
+			statements++;
+			continue;
+		}
+
+		auto doWhile = StaticCast<DoWhile>(child);
+		condition = doWhile ? StaticCast<Literal>(doWhile->children.back()) : nullptr;
+		if(condition && !condition->boolValue)
+		{
+			list.insert(list.end(), doWhile->children.begin(), doWhile->children.end() - 1);
+			statements++;
+			continue;
+		}
+
+		list.push_back(child);
+	}
+
+	node->children.swap(list);
+}
+
+void MarkReachable(NodePtr funDef, std::set<NodePtr>& reachable)
+{
+	if(!reachable.insert(funDef).second) return;
+
+	TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+	{
+		auto call = StaticCast<Call>(node);
+		if(!call) return;
+
+		if(call->dec->IsFamily<FunctionDef>()) MarkReachable(call->dec, reachable);
+		else reachable.insert(call->dec);
+	});
+}
+
+void EliminateDeadCode(NodePtr root, Statistics& statistics)
+{
+	int statements = 0, functions = 0, imports = 0, globals = 0;
+
+	PruneStatements(root, statements);
+
+	std::set<NodePtr> reachable;
+	for(auto node : root->children)
+	{
+		auto funDef = StaticCast<FunctionDef>(node);
+		if(funDef && funDef->exp) MarkReachable(funDef, reachable);
+	}
+
+	std::set<NodePtr> read;
+	std::map<NodePtr, std::vector<NodePtr>> writes;
+	for(auto funDef : reachable)
+	{
+		if(!funDef->IsFamily<FunctionDef>()) continue;
+
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			auto id = StaticCast<Identifier>(node);
+			if(id) read.insert(id->dec);
+
+			auto assign = StaticCast<Assignment>(node);
+			if(assign) writes[assign->dec].push_back(assign);
+		});
+	}
+
+	std::set<NodePtr> dead;
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		if(node->IsFamily<FunctionDef>() && !reachable.count(node))
+		{
+			dead.insert(node);
+			functions++;
+		}
+
+		if(node->IsFamily<FunctionDec>() && !reachable.count(node))
+		{
+			dead.insert(node);
+			imports++;
+		}
+
+		auto globalDec = StaticCast<GlobalDec>(node);
+		if(globalDec && !reachable.count(globalDec->getter) && !reachable.count(globalDec->setter)) dead.insert(node);
+
+		// A global that is only written to can go, unless computing a written value has side effects
+		auto globalDef = StaticCast<GlobalDef>(node);
+		if(globalDef && !globalDef->exp && !globalDef->var.array && !read.count(globalDef))
+		{
+			for(auto assign : writes[globalDef]) if(Count<Call>(assign) > 0) return;
+
+			dead.insert(globalDef);
+			dead.insert(writes[globalDef].begin(), writes[globalDef].end());
+			globals++;
+		}
+	});
+
+	Remove(root, dead);
+
+	statistics["dead_code.statements"] += statements;
+	statistics["dead_code.functions"] += functions;
+	statistics["dead_code.imports"] += imports;
+	statistics["dead_code.globals"] += globals;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Removes functions that are not reachable from an exported function or
+// __init, imports and non-exported globals that are never used, branches on
+// literal conditions and statements following a return. Removals are counted
+// under "dead_code.<kind>".
+void EliminateDeadCode(Nodes::NodePtr root, Statistics& statistics);
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "global_promotion.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+// The globals a call to a function can access, directly or through its callees
+struct GlobalAccess
+{
+	std::set<NodePtr> globals;
+	std::set<NodePtr> callees;
+	// Calls an external function, which can access any global
+	bool external = false;
+};
+
+static bool IsGlobal(NodePtr dec)
+{
+	return dec && (dec->IsFamily<GlobalDef>() || dec->IsFamily<GlobalDec>());
+}
+
+static bool IsScalarGlobal(NodePtr dec)
+{
+	auto globalDef = StaticCast<GlobalDef>(dec);
+	if(globalDef) return !globalDef->var.array;
+
+	auto globalDec = StaticCast<GlobalDec>(dec);
+	return globalDec && globalDec->param.dim.empty();
+}
+
+static std::map<NodePtr, GlobalAccess> AnalyseFunctions(NodePtr root)
+{
+	std::map<NodePtr, GlobalAccess> access;
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		auto& function = access[funDef];
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			auto id = StaticCast<Identifier>(node);
+			if(id && IsGlobal(id->dec)) function.globals.insert(id->dec);
+
+			auto assign = StaticCast<Assignment>(node);
+			if(assign && IsGlobal(assign->dec)) function.globals.insert(assign->dec);
+
+			auto call = StaticCast<Call>(node);
+			if(call && call->dec->IsFamily<FunctionDef>()) function.callees.insert(call->dec);
+			else if(call) function.external = true;
+		});
+	});
+
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(auto& pair : access)
+		{
+			auto& function = pair.second;
+			for(auto callee : function.callees)
+			{
+				if(callee == pair.first) continue;
+
+				const auto& other = access[callee];
+				size_t size = function.globals.size();
+				function.globals.insert(other.globals.begin(), other.globals.end());
+				changed = changed || size != function.globals.size() || (other.external && !function.external);
+				function.external = function.external || other.external;
+			}
+		}
+	}
+
+	return access;
+}
+
+// Collects the loops of a function, outer loops before the loops inside them
+static void CollectLoops(NodePtr node, std::vector<std::pair<NodePtr, NodePtr>>& loops)
+{
+	for(auto child : node->children)
+	{
+		if(child->IsFamily<FunctionDef>()) continue;
+
+		if(child->IsFamily<DoWhile>()) loops.push_back({ child, node });
+		CollectLoops(child, loops);
+	}
+}
+
+static std::shared_ptr<VarDec> PromoteGlobal(NodePtr global, bool written, NodePtr doWhile, NodePtr block, int& counter)
+{
+	auto globalDef = StaticCast<GlobalDef>(global);
+	auto globalDec = StaticCast<GlobalDec>(global);
+	std::string name = globalDef ? globalDef->var.name : globalDec->param.name;
+	Type type = globalDef ? globalDef->var.type : globalDec->param.type;
+
+	std::stringstream sstream;
+	sstream << "_G" << counter++ << "_" << name;
+
+	auto local = std::make_shared<VarDec>();
+	local->var.type = type;
+	local->var.name = sstream.str();
+
+	Replace<Identifier>(doWhile, [&](std::shared_ptr<Identifier> id) -> NodePtr
+	{
+		if(id->dec != global) return id;
+
+		auto load = std::make_shared<Identifier>(local->var.name);
+		load->dec = local;
+		load->type = type;
+		return load;
+	});
+
+	TraverseBreadth<Assignment>(doWhile, [&](std::shared_ptr<Assignment> assign, NodePtr)
+	{
+		if(assign->dec != global) return;
+
+		assign->name = local->var.name;
+		assign->dec = local;
+	});
+
+	auto loadId = std::make_shared<Identifier>(name);
+	loadId->dec = global;
+	loadId->type = type;
+
+	auto load = std::make_shared<Assignment>(local->var.name);
+	load->dec = local;
+	load->type = type;
+	load->children.push_back(loadId);
+
+	auto& siblings = block->children;
+	auto position = siblings.insert(std::find(siblings.begin(), siblings.end(), doWhile), load);
+
+	if(written)
+	{
+		auto storeId = std::make_shared<Identifier>(local->var.name);
+		storeId->dec = local;
+		storeId->type = type;
+
+		auto store = std::make_shared<Assignment>(name);
+		store->dec = global;
+		store->type = type;
+		store->children.push_back(storeId);
+
+		siblings.insert(position + 2, store);
+	}
+
+	return local;
+}
+
+static int PromoteLoop(NodePtr doWhile, NodePtr block, const std::map<NodePtr, GlobalAccess>& access, int& counter, std::vector<NodePtr>& locals)
+{
+	// In the order they are found, so the output does not depend on addresses
+	std::vector<NodePtr> globals;
+	std::set<NodePtr> written, observed;
+	bool external = false;
+
+	TraverseNot<FunctionDef>(doWhile, [&](NodePtr node, NodePtr)
+	{
+		auto id = StaticCast<Identifier>(node);
+		if(id && IsScalarGlobal(id->dec)) globals.push_back(id->dec);
+
+		auto assign = StaticCast<Assignment>(node);
+		if(assign && IsScalarGlobal(assign->dec))
+		{
+			globals.push_back(assign->dec);
+			written.insert(assign->dec);
+		}
+
+		auto call = StaticCast<Call>(node);
+		if(!call) return;
+
+		auto callee = access.find(call->dec);
+		if(callee == access.end()) external = true;
+		else
+		{
+			observed.insert(callee->second.globals.begin(), callee->second.globals.end());
+			external = external || callee->second.external;
+		}
+	});
+	if(external) return 0;
+
+	// The if around the loop reads the condition it shares with the loop before the local is loaded
+	if(block->IsFamily<If>() && block->children[0] == doWhile->children.back())
+	{
+		std::map<NodePtr, NodePtr> clones;
+		doWhile->children.back() = Clone(doWhile->children.back(), clones);
+	}
+
+	int promoted = 0;
+	std::set<NodePtr> done;
+	for(auto global : globals)
+	{
+		if(!done.insert(global).second || observed.count(global)) continue;
+
+		// A global of the module is as cheap to read as a local
+		if(!written.count(global) && !global->IsFamily<GlobalDec>()) continue;
+
+		locals.push_back(PromoteGlobal(global, written.count(global) > 0, doWhile, block, counter));
+		promoted++;
+	}
+
+	return promoted;
+}
+
+void PromoteGlobals(NodePtr root, Statistics& statistics)
+{
+	auto access = AnalyseFunctions(root);
+	int counter = 0, promoted = 0;
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		std::vector<std::pair<NodePtr, NodePtr>> loops;
+		CollectLoops(funDef, loops);
+
+		std::vector<NodePtr> locals;
+		for(const auto& loop : loops) promoted += PromoteLoop(loop.first, loop.second, access, counter, locals);
+
+		funDef->children.insert(funDef->children.begin(), locals.begin(), locals.end());
+	});
+
+	statistics["global_promotion.promoted"] += promoted;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Keeps scalar globals in a fresh _G local while a do-while loop runs, so
+// the loop accesses a local slot instead of the global or, for imported
+// globals, the getter and setter that CreateGettersSetters would call. Runs
+// before CreateGettersSetters. A global is promoted in the outermost loop
+// that writes it, or reads it when it is imported, as long as no call in the
+// loop can observe it: calls to functions of the module that, directly or
+// through their callees, neither access the global nor call an external
+// function. The local is loaded right before the loop and written back
+// right after it, when the loop writes it. Promoted globals are counted
+// under "global_promotion.promoted".
+void PromoteGlobals(Nodes::NodePtr root, Statistics& statistics);
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "inliner.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+struct InlineContext
+{
+	std::set<NodePtr> inlinable;
+	std::vector<NodePtr> locals;
+	int counter = 0;
+	int calls = 0;
+};
+
+// Callees entered at least 1/HotFraction times as often as the hottest function
+// of the profile may be HotFactor times larger than the threshold
+static const int HotFraction = 16;
+static const int HotFactor = 4;
+
+int InlineThreshold(int optimisationLevel)
+{
+	static const int thresholds[] = { 0, 16, 48, 128 };
+
+	if(optimisationLevel < 0) return 0;
+	return thresholds[std::min(optimisationLevel, 3)];
+}
+
+bool IsInlinable(std::shared_ptr<FunctionDef> funDef, int threshold)
+{
+	for(const auto& param : funDef->header.params) if(!param.dim.empty()) return false;
+
+	int size = 0;
+	std::set<NodePtr> locals;
+	TraverseBreadth(funDef, [&](NodePtr node, NodePtr)
+	{
+		size++;
+		if(node->IsFamily<VarDec>()) locals.insert(node);
+	});
+	if(size - 1 > threshold) return false;
+
+	bool inlinable = true;
+	TraverseBreadth(funDef, [&](NodePtr node, NodePtr)
+	{
+		if(node == funDef) return;
+		if(node->IsFamily<FunctionDef>() || node->IsFamily<ArrayExpr>() || node->IsFamily<AllocateArray>()) inlinable = false;
+
+		auto varDec = StaticCast<VarDec>(node);
+		if(varDec && varDec->var.array) inlinable = false;
+
+		auto call = StaticCast<Call>(node);
+		if(call && !call->dec->IsFamily<FunctionDec>()) inlinable = false;
+
+		// Variables of enclosing functions can not be reached from the caller
+		NodePtr dec = nullptr;
+		auto id = StaticCast<Identifier>(node);
+		if(id) dec = id->dec;
+		auto assign = StaticCast<Assignment>(node);
+		if(assign) dec = assign->dec;
+		if(dec && dec != funDef && !dec->IsFamily<GlobalDef>() && !locals.count(dec)) inlinable = false;
+	});
+
+	return inlinable;
+}
+
+// Whether evaluating the expression can neither have side effects nor fail
+bool IsPure(NodePtr root)
+{
+	bool pure = true;
+
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		if(node->IsFamily<Call>() || node->IsFamily<ArrayExpr>()) pure = false;
+
+		auto binOp = StaticCast<BinaryOp>(node);
+		if(binOp && (binOp->op == Operator::Divide || binOp->op == Operator::Modulo)) pure = false;
+	});
+
+	return pure;
+}
+
+// Whether the expression only reads the caller's frame, so it may be evaluated later
+bool IsLocal(NodePtr root)
+{
+	bool local = IsPure(root);
+
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		auto id = StaticCast<Identifier>(node);
+		if(id && !id->dec->IsFamily<VarDec>() && !id->dec->IsFamily<FunctionDef>()) local = false;
+	});
+
+	return local;
+}
+
+bool IsStatement(NodePtr parent, size_t index)
+{
+	if(parent->IsFamily<FunctionDef>() || parent->IsFamily<Else>()) return true;
+	if(parent->IsFamily<If>()) return index > 0;
+	if(parent->IsFamily<DoWhile>()) return index + 1 < parent->children.size();
+	return false;
+}
+
+NodePtr SubstituteParams(NodePtr node, NodePtr callee, std::map<std::string, NodePtr>& args)
+{
+	auto id = StaticCast<Identifier>(node);
+	if(id && id->dec == callee)
+	{
+		std::map<NodePtr, NodePtr> clones;
+		return Clone(args[id->name], clones);
+	}
+
+	for(auto& child : node->children) child = SubstituteParams(child, callee, args);
+	return node;
+}
+
+// Replaces a call to a function consisting of a single return statement by the
+// returned expression. Arguments are substituted for the parameters, which is
+// only done when that can not change the order or number of their evaluations.
+NodePtr InlineExpression(std::shared_ptr<Call> call)
+{
+	auto callee = StaticCast<FunctionDef>(call->dec);
+	if(callee->children.size() != 1) return nullptr;
+
+	auto ret = StaticCast<Return>(callee->children[0]);
+	if(!ret || ret->children.empty()) return nullptr;
+
+	std::map<std::string, int> uses;
+	TraverseBreadth<Identifier>(ret, [&](std::shared_ptr<Identifier> id, NodePtr)
+	{
+		if(id->dec == callee) uses[id->name]++;
+	});
+
+	std::map<std::string, NodePtr> args;
+	for(size_t i = 0; i < call->children.size(); ++i)
+	{
+		auto arg = call->children[i];
+		const auto& name = callee->header.params[i].name;
+		bool simple = arg->IsFamily<Literal>() || (arg->IsFamily<Identifier>() && IsLocal(arg));
+
+		if(!simple && !(IsLocal(arg) && uses[name] <= 1)) return nullptr;
+		args[name] = arg;
+	}
+
+	std::map<NodePtr, NodePtr> clones;
+	auto expr = Clone(ret->children[0], clones);
+	return SubstituteParams(expr, callee, args);
+}
+
+std::shared_ptr<VarDec> FreshLocal(InlineContext& context, Type type, const std::string& name)
+{
+	std::stringstream sstream;
+	sstream << "_I" << context.counter++ << name;
+
+	auto local = std::make_shared<VarDec>();
+	local->var.type = type;
+	local->var.name = sstream.str();
+	context.locals.push_back(local);
+	return local;
+}
+
+// Replaces a call statement by assignments of the arguments to fresh locals
+// followed by a copy of the callee's body
+bool InlineStatement(std::shared_ptr<Call> call, std::vector<NodePtr>& list, InlineContext& context)
+{
+	auto callee = StaticCast<FunctionDef>(call->dec);
+	auto ret = callee->children.empty() ? nullptr : StaticCast<Return>(callee->children.back());
+	auto result = ret && !ret->children.empty() ? ret->children[0] : nullptr;
+
+	// The returned value is discarded, but computing it must keep its effects
+	if(result && !IsPure(result) && !result->IsFamily<Call>()) return false;
+
+	std::vector<NodePtr> statements;
+	std::map<std::string, NodePtr> params;
+	for(size_t i = 0; i < call->children.size(); ++i)
+	{
+		const auto& param = callee->header.params[i];
+		auto local = FreshLocal(context, param.type, param.name);
+		auto assign = std::make_shared<Assignment>(local->var.name);
+
+		assign->dec = local;
+		assign->type = param.type;
+		assign->children.push_back(call->children[i]);
+		statements.push_back(assign);
+		params[param.name] = local;
+	}
+
+	std::map<NodePtr, NodePtr> clones;
+	std::set<NodePtr> varDecs;
+	size_t body = statements.size();
+	for(auto child : callee->children)
+	{
+		if(child == ret) continue;
+		statements.push_back(Clone(child, clones));
+	}
+	if(result && result->IsFamily<Call>()) statements.push_back(Clone(result, clones));
+
+	for(size_t i = body; i < statements.size(); ++i)
+	{
+		TraverseBreadth(statements[i], [&](NodePtr node, NodePtr)
+		{
+			auto varDec = StaticCast<VarDec>(node);
+			if(varDec)
+			{
+				auto local = FreshLocal(context, varDec->var.type, varDec->var.name);
+				clones[varDec] = local;
+				varDecs.insert(varDec);
+			}
+		});
+	}
+
+	// Point the copied body at the fresh locals
+	for(size_t i = body; i < statements.size(); ++i)
+	{
+		TraverseBreadth(statements[i], [&](NodePtr node, NodePtr)
+		{
+			auto id = StaticCast<Identifier>(node);
+			auto assign = StaticCast<Assignment>(node);
+			NodePtr dec = id ? id->dec : assign ? assign->dec : nullptr;
+			if(!dec) return;
+
+			NodePtr local = dec == callee ? params[id ? id->name : assign->name] : clones.count(dec) ? clones[dec] : nullptr;
+			if(!local) return;
+
+			const auto& name = std::static_pointer_cast<VarDec>(local)->var.name;
+			if(id) id->dec = local, id->name = name;
+			else assign->dec = local, assign->name = name;
+		});
+	}
+
+	for(auto& statement : statements)
+	{
+		if(varDecs.count(statement)) continue;
+		Remove(statement, varDecs);
+		list.push_back(statement);
+	}
+
+	return true;
+}
+
+void InlineCalls(NodePtr node, InlineContext& context)
+{
+	std::vector<NodePtr> list;
+
+	for(size_t i = 0; i < node->children.size(); ++i)
+	{
+		auto& child = node->children[i];
+		if(child->IsFamily<FunctionDef>())
+		{
+			list.push_back(child);
+			continue;
+		}
+
+		InlineCalls(child, context);
+
+		auto call = StaticCast<Call>(child);
+		if(call && context.inlinable.count(call->dec))
+		{
+			if(IsStatement(node, i))
+			{
+				if(InlineStatement(call, list, context))
+				{
+					context.calls++;
+					continue;
+				}
+			}
+			else
+			{
+				auto expr = InlineExpression(call);
+				if(expr)
+				{
+					child = expr;
+					context.calls++;
+				}
+			}
+		}
+
+		list.push_back(child);
+	}
+
+	node->children.swap(list);
+}
+
+void InlineFunctions(NodePtr root, int threshold, Statistics& statistics)
+{
+	// Every round inlines the current leaves, which can turn their callers into leaves
+	const int rounds = 3;
+	int calls = 0;
+	InlineContext context;
+
+	for(int round = 0; round < rounds; ++round)
+	{
+		context.inlinable.clear();
+		std::vector<std::shared_ptr<FunctionDef>> funDefs;
+		long long hottest = 0;
+
+		TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+		{
+			funDefs.push_back(funDef);
+			hottest = std::max(hottest, funDef->profileCount);
+		});
+
+		for(auto funDef : funDefs)
+		{
+			bool hot = hottest > 0 && funDef->profileCount * HotFraction >= hottest;
+			if(IsInlinable(funDef, hot ? threshold * HotFactor : threshold)) context.inlinable.insert(funDef);
+		}
+
+		for(auto funDef : funDefs)
+		{
+			InlineCalls(funDef, context);
+			funDef->children.insert(funDef->children.begin(), context.locals.begin(), context.locals.end());
+			context.locals.clear();
+		}
+
+		if(context.calls == calls) break;
+		calls = context.calls;
+	}
+
+	statistics["inliner.calls"] += calls;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Largest callee, in nodes, that is inlined at the given -O level
+int InlineThreshold(int optimisationLevel);
+
+// Replaces calls to small leaf functions by the body of the callee. Callees
+// may only call imported functions and may not contain nested functions,
+// arrays or references to variables of enclosing functions. Parameters and
+// locals of the callee become fresh locals at the start of the caller.
+// With a profile, hot callees may be larger than the threshold.
+// Inlined calls are counted under "inliner.calls".
+void InlineFunctions(Nodes::NodePtr root, int threshold, Statistics& statistics);
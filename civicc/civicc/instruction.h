@@ -29,6 +29,16 @@ public:
 	static const std::string ParseInstr(const std::string instr, const int arg1, const int arg2);
 };
 
+class ConstantTable
+{
+public:
+	int Index(const std::string type, const std::string value);
+	const std::string ToString() const;
+
+private:
+	std::vector<std::tuple<std::string, std::string>> constants;
+};
+
 class ArithInstr
 {
 public:	
@@ -39,8 +49,8 @@ public:
 	static const std::string Modulo(Instr::Type type);
 	static const std::string Negate(Instr::Type type);
 	static const std::string Not(Instr::Type type);
-	static const std::string Increment(const std::string local, const int constant);
-	static const std::string Decrement(const std::string local, const int constant);
+	static const std::string Increment(ConstantTable& constants, const int local, const int value);
+	static const std::string Decrement(ConstantTable& constants, const int local, const int value);
 
 private:
 	static const std::string iAdd;
@@ -146,13 +156,12 @@ public:
 	static const std::string StoreRelative(Instr::Type, const int levels, const int index);
 	static const std::string StoreGlobal(Instr::Type, const int index);
 	
-	static const std::string LoadConstant(const int value);
-	static const std::string LoadConstant(const float value);
+	static const std::string LoadConstant(ConstantTable& constants, const int value);
+	static const std::string LoadConstant(ConstantTable& constants, const float value);
 	static const std::string LoadConstant(const bool value);
-	static const std::string GetConstantTable();
 
 private:
-	static const std::string LoadConstant(const std::string instr, const std::string value, const std::string type);
+	static const std::string LoadConstant(ConstantTable& constants, const std::string instr, const std::string value, const std::string type);
 
 	static const std::string iLoad;
 	static const std::string fLoad;	
@@ -187,8 +196,6 @@ private:
 	static const std::string fStoreG;
 	static const std::string bStoreG;
 	static const std::string aStoreG;
-
-	static std::vector<std::tuple<std::string, std::string>> constants;
 };
 
 class ArrayInstr
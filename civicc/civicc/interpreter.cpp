@@ -0,0 +1,634 @@
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include "interpreter.h"
+#include "listing.h"
+
+
+#define OPCODES(X) \
+	X(Halt) X(Load) X(Store) X(LoadN) X(StoreN) X(LoadG) X(StoreG) X(Push) \
+	X(IAdd) X(ISub) X(IMul) X(IDiv) X(IRem) X(INeg) X(FAdd) X(FSub) X(FMul) X(FDiv) X(FNeg) X(BNot) X(Inc) \
+	X(IEq) X(INe) X(ILt) X(ILe) X(IGt) X(IGe) X(FEq) X(FNe) X(FLt) X(FLe) X(FGt) X(FGe) \
+	X(I2F) X(F2I) X(Pop) X(Jump) X(BranchT) X(BranchF) \
+	X(Isr) X(Isrl) X(Isrn) X(Isrg) X(Jsr) X(Native) X(Esr) X(Return) X(ReturnVoid) \
+	X(NewArray) X(LoadArray) X(StoreArray) X(ArraySize)
+
+#define OPCODE_ENUM(name) name,
+enum class Opcode { OPCODES(OPCODE_ENUM) };
+
+struct Array;
+
+union Value
+{
+	long long i;
+	double f;
+	Array* a;
+};
+
+struct Array
+{
+	std::vector<long long> dims;
+	std::vector<Value> elements;
+};
+
+struct Operation
+{
+	Opcode opcode;
+	const void* handler;
+	int a, b;
+	Value value;
+};
+
+struct Native
+{
+	const char* name;
+	int params;
+	bool result;
+	void (*function)(Value* args, Value& result, RunResult& run);
+};
+
+static const Native natives[] =
+{
+	{ "printInt", 1, false, [](Value* args, Value&, RunResult&) { std::printf("%lld", args[0].i); } },
+	{ "printFloat", 1, false, [](Value* args, Value&, RunResult&) { std::printf("%f", args[0].f); } },
+	{ "printSpaces", 1, false, [](Value* args, Value&, RunResult&) { for(long long n = 0; n < args[0].i; ++n) std::putchar(' '); } },
+	{ "printNewlines", 1, false, [](Value* args, Value&, RunResult&) { for(long long n = 0; n < args[0].i; ++n) std::putchar('\n'); } },
+	{ "scanInt", 0, true, [](Value*, Value& result, RunResult&) { result.i = 0; if(std::scanf("%lld", &result.i) != 1) result.i = 0; } },
+	{ "scanFloat", 0, true, [](Value*, Value& result, RunResult&) { result.f = 0; if(std::scanf("%lf", &result.f) != 1) result.f = 0; } },
+	{ "__profile_count", 1, false, [](Value* args, Value&, RunResult& run) { run.profile[args[0].i]++; } },
+};
+
+struct Signature
+{
+	std::string name, returnType;
+	std::vector<std::string> params;
+	std::string label;
+};
+
+struct Module
+{
+	std::vector<std::pair<std::string, std::string>> constants;
+	std::vector<Signature> imports, exports;
+	std::map<std::string, int> labels;
+	int globalBase = 0;
+};
+
+struct Program
+{
+	std::vector<Operation> code;
+	std::vector<Module> modules;
+	std::vector<std::string> globalTypes;
+	std::vector<Value> globals;
+	std::vector<std::unique_ptr<Array>> arrays;
+};
+
+// Operand of an instruction that has to be resolved once every module is loaded
+struct Fixup
+{
+	size_t operation;
+	size_t module;
+	std::string label;
+	int import;
+};
+
+static const size_t StackSize = 1 << 22;
+// Slots a function may push on top of its frame before the next overflow check
+static const size_t StackMargin = 1024;
+
+static int ParseOperand(const AsmLine& line, size_t index)
+{
+	if(index >= line.args.size()) throw std::runtime_error("missing operand of " + line.text);
+
+	char* end;
+	long value = std::strtol(line.args[index].c_str(), &end, 10);
+	if(*end != '\0' || line.args[index].empty()) throw std::runtime_error("invalid operand of " + line.text + ": " + line.args[index]);
+	return (int)value;
+}
+
+static Signature ParseSignature(const std::string& directive, bool exported)
+{
+	std::stringstream words(directive);
+	std::string word;
+	Signature signature;
+
+	words >> word >> signature.name >> signature.returnType;
+	if(signature.name.size() < 2 || signature.name.front() != '"' || signature.name.back() != '"') throw std::runtime_error("invalid directive: " + directive);
+	signature.name = signature.name.substr(1, signature.name.size() - 2);
+
+	while(words >> word) signature.params.push_back(word);
+	if(exported)
+	{
+		if(signature.params.empty()) throw std::runtime_error("missing label in directive: " + directive);
+		signature.label = signature.params.back();
+		signature.params.pop_back();
+	}
+
+	return signature;
+}
+
+static Value ConstantValue(const Module& module, const AsmLine& line, const std::string& type)
+{
+	int index = ParseOperand(line, 0);
+	if(index < 0 || index >= (int)module.constants.size()) throw std::runtime_error("constants index out of range");
+
+	const auto& constant = module.constants[index];
+	if(constant.first != type) throw std::runtime_error("reading constant of incorrect type");
+
+	Value value;
+	// Float constants are read in single precision, like civvm does
+	if(type == "float") value.f = std::strtof(constant.second.c_str(), nullptr);
+	else value.i = std::strtoll(constant.second.c_str(), nullptr, 10);
+	return value;
+}
+
+// Splits a mnemonic like iload_2 into its base and the operand after the underscore
+static bool ShortForm(const std::string& text, const std::string& base, int& operand)
+{
+	if(text.size() != base.size() + 2 || text.compare(0, base.size(), base) != 0 || text[base.size()] != '_') return false;
+	char digit = text[base.size() + 1];
+	if(digit < '0' || digit > '3') return false;
+
+	operand = digit - '0';
+	return true;
+}
+
+static bool TypedForm(const std::string& text, const std::string& base, const char* prefixes)
+{
+	if(text.size() != base.size() + 1 || text.compare(1, std::string::npos, base) != 0) return false;
+	for(const char* prefix = prefixes; *prefix; ++prefix) if(text[0] == *prefix) return true;
+	return false;
+}
+
+static Operation Decode(const AsmLine& line, size_t moduleIndex, Program& program, std::vector<Fixup>& fixups)
+{
+	const auto& module = program.modules[moduleIndex];
+	const auto& text = line.text;
+
+	Operation operation;
+	operation.handler = nullptr;
+	operation.a = operation.b = 0;
+	operation.value.i = 0;
+
+	auto simple = [&](Opcode opcode) { operation.opcode = opcode; return operation; };
+	auto label = [&](Opcode opcode, size_t index)
+	{
+		if(index >= line.args.size()) throw std::runtime_error("missing label of " + text);
+		fixups.push_back({ program.code.size(), moduleIndex, line.args[index], -1 });
+		operation.opcode = opcode;
+		return operation;
+	};
+
+	static const std::map<std::string, Opcode> plain =
+	{
+		{ "iadd", Opcode::IAdd }, { "isub", Opcode::ISub }, { "imul", Opcode::IMul }, { "idiv", Opcode::IDiv },
+		{ "irem", Opcode::IRem }, { "ineg", Opcode::INeg }, { "fadd", Opcode::FAdd }, { "fsub", Opcode::FSub },
+		{ "fmul", Opcode::FMul }, { "fdiv", Opcode::FDiv }, { "fneg", Opcode::FNeg }, { "bnot", Opcode::BNot },
+		{ "ieq", Opcode::IEq }, { "ine", Opcode::INe }, { "ilt", Opcode::ILt }, { "ile", Opcode::ILe },
+		{ "igt", Opcode::IGt }, { "ige", Opcode::IGe }, { "feq", Opcode::FEq }, { "fne", Opcode::FNe },
+		{ "flt", Opcode::FLt }, { "fle", Opcode::FLe }, { "fgt", Opcode::FGt }, { "fge", Opcode::FGe },
+		{ "beq", Opcode::IEq }, { "bne", Opcode::INe }, { "i2f", Opcode::I2F }, { "f2i", Opcode::F2I },
+		{ "ipop", Opcode::Pop }, { "fpop", Opcode::Pop }, { "bpop", Opcode::Pop }, { "isr", Opcode::Isr },
+		{ "isrl", Opcode::Isrl }, { "isrg", Opcode::Isrg }, { "return", Opcode::ReturnVoid },
+		{ "ireturn", Opcode::Return }, { "freturn", Opcode::Return }, { "breturn", Opcode::Return },
+		{ "iloada", Opcode::LoadArray }, { "floada", Opcode::LoadArray }, { "bloada", Opcode::LoadArray },
+		{ "istorea", Opcode::StoreArray }, { "fstorea", Opcode::StoreArray }, { "bstorea", Opcode::StoreArray },
+	};
+
+	auto it = plain.find(text);
+	if(it != plain.end()) return simple(it->second);
+
+	int operand;
+	if(ShortForm(text, "iload", operand) || ShortForm(text, "fload", operand) || ShortForm(text, "bload", operand) || ShortForm(text, "aload", operand))
+	{
+		operation.a = operand;
+		return simple(Opcode::Load);
+	}
+	if(TypedForm(text, "load", "ifba")) { operation.a = ParseOperand(line, 0); return simple(Opcode::Load); }
+	if(TypedForm(text, "store", "ifba")) { operation.a = ParseOperand(line, 0); return simple(Opcode::Store); }
+	if(TypedForm(text, "loadn", "ifba") || TypedForm(text, "storen", "ifba"))
+	{
+		operation.a = ParseOperand(line, 0);
+		operation.b = ParseOperand(line, 1);
+		return simple(text[1] == 'l' ? Opcode::LoadN : Opcode::StoreN);
+	}
+	if(TypedForm(text, "loadg", "ifba") || TypedForm(text, "storeg", "ifba"))
+	{
+		int index = ParseOperand(line, 0);
+		if(index < 0 || module.globalBase + index >= (int)program.globalTypes.size()) throw std::runtime_error("global index out of range");
+		operation.a = module.globalBase + index;
+		return simple(text[1] == 'l' ? Opcode::LoadG : Opcode::StoreG);
+	}
+
+	if(text == "iloadc") { operation.value = ConstantValue(module, line, "int"); return simple(Opcode::Push); }
+	if(text == "floadc") { operation.value = ConstantValue(module, line, "float"); return simple(Opcode::Push); }
+	if(text == "iloadc_0" || text == "iloadc_1" || text == "iloadc_m1")
+	{
+		operation.value.i = text == "iloadc_m1" ? -1 : text.back() - '0';
+		return simple(Opcode::Push);
+	}
+	if(text == "floadc_0" || text == "floadc_1")
+	{
+		operation.value.f = text.back() - '0';
+		return simple(Opcode::Push);
+	}
+	if(text == "bloadc_t" || text == "bloadc_f")
+	{
+		operation.value.i = text.back() == 't';
+		return simple(Opcode::Push);
+	}
+
+	if(text == "iinc_1" || text == "idec_1")
+	{
+		operation.a = ParseOperand(line, 0);
+		operation.value.i = text[1] == 'i' ? 1 : -1;
+		return simple(Opcode::Inc);
+	}
+	if(text == "iinc" || text == "idec")
+	{
+		operation.a = ParseOperand(line, 0);
+		AsmLine constant = line;
+		constant.args.erase(constant.args.begin());
+		operation.value = ConstantValue(module, constant, "int");
+		if(text == "idec") operation.value.i = -operation.value.i;
+		return simple(Opcode::Inc);
+	}
+
+	if(text == "jump") return label(Opcode::Jump, 0);
+	if(text == "branch_t") return label(Opcode::BranchT, 0);
+	if(text == "branch_f") return label(Opcode::BranchF, 0);
+	if(text == "isrn") { operation.a = ParseOperand(line, 0); return simple(Opcode::Isrn); }
+	if(text == "jsr")
+	{
+		operation.a = ParseOperand(line, 0);
+		return label(Opcode::Jsr, 1);
+	}
+	if(text == "jsre")
+	{
+		int import = ParseOperand(line, 0);
+		if(import < 0 || import >= (int)module.imports.size()) throw std::runtime_error("attempting to call imported function outside the import table");
+		fixups.push_back({ program.code.size(), moduleIndex, "", import });
+		return simple(Opcode::Jsr);
+	}
+	if(text == "esr") { operation.a = ParseOperand(line, 0); return simple(Opcode::Esr); }
+
+	if(TypedForm(text, "newa", "ifb")) { operation.a = ParseOperand(line, 0); return simple(Opcode::NewArray); }
+	if(text == "asize") { operation.a = line.args.empty() ? 0 : ParseOperand(line, 0); return simple(Opcode::ArraySize); }
+
+	throw std::runtime_error("executing illegal instruction " + text);
+}
+
+static void Load(const std::string& assembly, Program& program, std::vector<Fixup>& fixups)
+{
+	auto listing = ParseListing(assembly);
+
+	program.modules.emplace_back();
+	size_t moduleIndex = program.modules.size() - 1;
+	auto& module = program.modules.back();
+	module.globalBase = (int)program.globalTypes.size();
+
+	// Directives follow the code, so they are all read before any instruction is decoded
+	size_t position = program.code.size();
+	for(const auto& line : listing)
+	{
+		if(line.kind == AsmLine::Instruction) position++;
+		else if(line.kind == AsmLine::Label) module.labels[line.text] = (int)position;
+		else if(line.kind == AsmLine::Directive)
+		{
+			std::stringstream words(line.text);
+			std::string directive, type, value;
+			words >> directive;
+
+			if(directive == ".const")
+			{
+				words >> type >> value;
+				module.constants.push_back({ type, value });
+			}
+			else if(directive == ".global")
+			{
+				words >> type;
+				program.globalTypes.push_back(type);
+			}
+			else if(directive == ".import") module.imports.push_back(ParseSignature(line.text, false));
+			else if(directive == ".export") module.exports.push_back(ParseSignature(line.text, true));
+			else throw std::runtime_error("unknown directive " + directive);
+		}
+	}
+
+	for(const auto& line : listing)
+	{
+		if(line.kind == AsmLine::Instruction) program.code.push_back(Decode(line, moduleIndex, program, fixups));
+	}
+}
+
+static void Link(Program& program, const std::vector<Fixup>& fixups)
+{
+	for(const auto& fixup : fixups)
+	{
+		const auto& module = program.modules[fixup.module];
+		auto& operation = program.code[fixup.operation];
+
+		if(fixup.import < 0)
+		{
+			auto it = module.labels.find(fixup.label);
+			if(it == module.labels.end()) throw std::runtime_error("undefined label " + fixup.label);
+			operation.b = it->second;
+			if(operation.opcode != Opcode::Jsr) operation.a = it->second;
+			continue;
+		}
+
+		const auto& import = module.imports[fixup.import];
+		operation.a = (int)import.params.size();
+
+		bool resolved = false;
+		for(size_t m = 0; m < program.modules.size() && !resolved; ++m)
+		{
+			for(const auto& exported : program.modules[m].exports)
+			{
+				if(exported.name != import.name) continue;
+				if(exported.returnType != import.returnType || exported.params != import.params)
+				{
+					throw std::runtime_error("signature of import " + import.name + " does not match its export");
+				}
+
+				operation.b = program.modules[m].labels.at(exported.label);
+				resolved = true;
+				break;
+			}
+		}
+
+		for(size_t n = 0; n < sizeof(natives) / sizeof(natives[0]) && !resolved; ++n)
+		{
+			if(import.name != natives[n].name) continue;
+			if((int)import.params.size() != natives[n].params) throw std::runtime_error("signature of import " + import.name + " does not match its native");
+
+			operation.opcode = Opcode::Native;
+			operation.b = (int)n;
+			resolved = true;
+		}
+
+		if(!resolved) throw std::runtime_error("unresolved import " + import.name);
+	}
+}
+
+static Array* NewArray(Program& program, Value* sizes, int dimensions)
+{
+	std::unique_ptr<Array> array(new Array());
+	long long count = 1;
+	for(int d = 0; d < dimensions; ++d)
+	{
+		if(sizes[d].i <= 0) throw std::runtime_error("invalid bound size in array creation");
+		array->dims.push_back(sizes[d].i);
+		count *= sizes[d].i;
+	}
+
+	Value zero;
+	zero.i = 0;
+	array->elements.assign((size_t)count, zero);
+	program.arrays.push_back(std::move(array));
+	return program.arrays.back().get();
+}
+
+// Calls the function at entry with an empty stack, returns its value, if any
+static long long Execute(Program& program, int entry, Value* stack, RunResult& result)
+{
+	// The first three slots of a frame hold the static link, the caller's frame and the return address
+#ifdef __GNUC__
+#define OPCODE_LABEL(name) &&op_##name,
+	static const void* handlers[] = { OPCODES(OPCODE_LABEL) };
+	for(auto& operation : program.code) operation.handler = handlers[(int)operation.opcode];
+#define OP(name) op_##name:
+#define NEXT() do { ++executed; goto *pc->handler; } while(0)
+#else
+#define OP(name) case Opcode::name:
+#define NEXT() do { ++executed; goto dispatch; } while(0)
+#endif
+#define JUMP(target) do { pc = code + (target); NEXT(); } while(0)
+
+	Operation* code = program.code.data();
+	Value* stackEnd = stack + StackSize - StackMargin;
+	unsigned long long executed = 0;
+
+	Value* sp = stack;
+	sp[0].i = -1;
+	sp[1].i = 0;
+	sp[2].i = 0;
+	sp += 3;
+	Value* fp = sp;
+	Operation* pc = code + entry;
+
+	NEXT();
+
+#ifndef __GNUC__
+dispatch:
+	switch(pc->opcode)
+#endif
+	{
+	OP(Halt)
+		result.instructions += executed - 1;
+		return sp > stack ? stack[0].i : 0;
+
+	OP(Load) *sp++ = fp[pc->a]; ++pc; NEXT();
+	OP(Store) fp[pc->a] = *--sp; ++pc; NEXT();
+	OP(LoadN)
+	{
+		Value* frame = fp;
+		for(int level = 0; level < pc->a; ++level) frame = stack + frame[-3].i;
+		*sp++ = frame[pc->b];
+		++pc; NEXT();
+	}
+	OP(StoreN)
+	{
+		Value* frame = fp;
+		for(int level = 0; level < pc->a; ++level) frame = stack + frame[-3].i;
+		frame[pc->b] = *--sp;
+		++pc; NEXT();
+	}
+	OP(LoadG) *sp++ = program.globals[pc->a]; ++pc; NEXT();
+	OP(StoreG) program.globals[pc->a] = *--sp; ++pc; NEXT();
+	OP(Push) *sp++ = pc->value; ++pc; NEXT();
+
+	OP(IAdd) sp[-2].i += sp[-1].i; --sp; ++pc; NEXT();
+	OP(ISub) sp[-2].i -= sp[-1].i; --sp; ++pc; NEXT();
+	OP(IMul) sp[-2].i *= sp[-1].i; --sp; ++pc; NEXT();
+	OP(IDiv)
+		if(sp[-1].i == 0) throw std::runtime_error("division by zero");
+		sp[-2].i /= sp[-1].i; --sp; ++pc; NEXT();
+	OP(IRem)
+		if(sp[-1].i == 0) throw std::runtime_error("division by zero");
+		sp[-2].i %= sp[-1].i; --sp; ++pc; NEXT();
+	OP(INeg) sp[-1].i = -sp[-1].i; ++pc; NEXT();
+	OP(FAdd) sp[-2].f += sp[-1].f; --sp; ++pc; NEXT();
+	OP(FSub) sp[-2].f -= sp[-1].f; --sp; ++pc; NEXT();
+	OP(FMul) sp[-2].f *= sp[-1].f; --sp; ++pc; NEXT();
+	OP(FDiv) sp[-2].f /= sp[-1].f; --sp; ++pc; NEXT();
+	OP(FNeg) sp[-1].f = -sp[-1].f; ++pc; NEXT();
+	OP(BNot) sp[-1].i = !sp[-1].i; ++pc; NEXT();
+	OP(Inc) fp[pc->a].i += pc->value.i; ++pc; NEXT();
+
+	OP(IEq) sp[-2].i = sp[-2].i == sp[-1].i; --sp; ++pc; NEXT();
+	OP(INe) sp[-2].i = sp[-2].i != sp[-1].i; --sp; ++pc; NEXT();
+	OP(ILt) sp[-2].i = sp[-2].i < sp[-1].i; --sp; ++pc; NEXT();
+	OP(ILe) sp[-2].i = sp[-2].i <= sp[-1].i; --sp; ++pc; NEXT();
+	OP(IGt) sp[-2].i = sp[-2].i > sp[-1].i; --sp; ++pc; NEXT();
+	OP(IGe) sp[-2].i = sp[-2].i >= sp[-1].i; --sp; ++pc; NEXT();
+	OP(FEq) sp[-2].i = sp[-2].f == sp[-1].f; --sp; ++pc; NEXT();
+	OP(FNe) sp[-2].i = sp[-2].f != sp[-1].f; --sp; ++pc; NEXT();
+	OP(FLt) sp[-2].i = sp[-2].f < sp[-1].f; --sp; ++pc; NEXT();
+	OP(FLe) sp[-2].i = sp[-2].f <= sp[-1].f; --sp; ++pc; NEXT();
+	OP(FGt) sp[-2].i = sp[-2].f > sp[-1].f; --sp; ++pc; NEXT();
+	OP(FGe) sp[-2].i = sp[-2].f >= sp[-1].f; --sp; ++pc; NEXT();
+
+	OP(I2F) sp[-1].f = (double)sp[-1].i; ++pc; NEXT();
+	OP(F2I) sp[-1].i = (long long)sp[-1].f; ++pc; NEXT();
+	OP(Pop) --sp; ++pc; NEXT();
+	OP(Jump) JUMP(pc->a);
+	OP(BranchT) if((--sp)->i) JUMP(pc->a); ++pc; NEXT();
+	OP(BranchF) if(!(--sp)->i) JUMP(pc->a); ++pc; NEXT();
+
+	OP(Isr) sp[0].i = fp[-3].i; sp += 3; ++pc; NEXT();
+	OP(Isrl) sp[0].i = fp - stack; sp += 3; ++pc; NEXT();
+	OP(Isrn)
+	{
+		long long link = fp[-3].i;
+		for(int level = 0; level < pc->a && link >= 0; ++level) link = stack[link - 3].i;
+		if(link < 0) throw std::runtime_error("invalid static depth");
+		sp[0].i = link;
+		sp += 3;
+		++pc; NEXT();
+	}
+	OP(Isrg) sp[0].i = -1; sp += 3; ++pc; NEXT();
+	OP(Jsr)
+	{
+		Value* frame = sp - pc->a;
+		frame[-2].i = fp - stack;
+		frame[-1].i = pc - code + 1;
+		fp = frame;
+		JUMP(pc->b);
+	}
+	OP(Native)
+	{
+		const auto& native = natives[pc->b];
+		Value* frame = sp - pc->a;
+		native.function(frame, frame[-3], result);
+		sp = frame - 3 + (native.result ? 1 : 0);
+		++pc; NEXT();
+	}
+	OP(Esr)
+		if(sp + pc->a >= stackEnd) throw std::runtime_error("attempting to write outside of stack");
+		for(int local = 0; local < pc->a; ++local) sp[local].i = 0;
+		sp += pc->a;
+		++pc; NEXT();
+	OP(Return)
+	{
+		Value value = sp[-1];
+		sp = fp - 3;
+		pc = code + fp[-1].i;
+		fp = stack + fp[-2].i;
+		*sp++ = value;
+		NEXT();
+	}
+	OP(ReturnVoid)
+		sp = fp - 3;
+		pc = code + fp[-1].i;
+		fp = stack + fp[-2].i;
+		NEXT();
+
+	OP(NewArray)
+		sp -= pc->a;
+		sp->a = NewArray(program, sp, pc->a);
+		++sp;
+		++pc; NEXT();
+	OP(LoadArray)
+	{
+		Array* array = sp[-1].a;
+		long long index = sp[-2].i;
+		if(index < 0 || index >= (long long)array->elements.size()) throw std::runtime_error("array index out of bounds");
+		sp[-2] = array->elements[index];
+		--sp;
+		++pc; NEXT();
+	}
+	OP(StoreArray)
+	{
+		Array* array = sp[-1].a;
+		long long index = sp[-2].i;
+		if(index < 0 || index >= (long long)array->elements.size()) throw std::runtime_error("array index out of bounds");
+		array->elements[index] = sp[-3];
+		sp -= 3;
+		++pc; NEXT();
+	}
+	OP(ArraySize)
+	{
+		Array* array = sp[-1].a;
+		if(pc->a < 0 || pc->a >= (int)array->dims.size()) throw std::runtime_error("array dimension out of bounds in size request");
+		sp[-1].i = array->dims[pc->a];
+		++pc; NEXT();
+	}
+	}
+
+#undef OP
+#undef NEXT
+#undef JUMP
+	return 0;
+}
+
+RunResult RunAssembly(const std::vector<std::string>& modules)
+{
+	RunResult result;
+	Program program;
+
+	try
+	{
+		Operation halt;
+		halt.opcode = Opcode::Halt;
+		program.code.push_back(halt);
+
+		std::vector<Fixup> fixups;
+		for(const auto& assembly : modules) Load(assembly, program, fixups);
+		Link(program, fixups);
+	}
+	catch(const std::runtime_error& e)
+	{
+		result.error = std::string("error: ") + e.what();
+		return result;
+	}
+
+	std::vector<int> inits;
+	int main = -1;
+	for(const auto& module : program.modules)
+	{
+		for(const auto& exported : module.exports)
+		{
+			if(exported.name == "__init") inits.push_back(module.labels.at(exported.label));
+			if(exported.name == "main") main = module.labels.at(exported.label);
+		}
+	}
+
+	if(main < 0)
+	{
+		result.error = "error: no exported main function";
+		return result;
+	}
+
+	Value zero;
+	zero.i = 0;
+	program.globals.assign(program.globalTypes.size(), zero);
+	std::vector<Value> stack(StackSize);
+
+	try
+	{
+		for(int init : inits) Execute(program, init, stack.data(), result);
+		result.exitValue = Execute(program, main, stack.data(), result);
+		result.success = true;
+	}
+	catch(const std::runtime_error& e)
+	{
+		result.error = std::string("Exception: ") + e.what();
+	}
+
+	std::fflush(stdout);
+	return result;
+}
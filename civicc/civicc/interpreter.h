@@ -0,0 +1,25 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+struct RunResult
+{
+	bool success = false;
+	// Value returned by main, or zero when it returns nothing
+	long long exitValue = 0;
+	unsigned long long instructions = 0;
+	std::string error;
+	// Counts of the profile points of a program built with --instrument
+	std::map<int, long long> profile;
+};
+
+// Runs modules of civicc assembly in process. Every module is decoded into one
+// shared code array, imports are linked against the exports of the other modules
+// or the native printInt, printFloat, printSpaces, printNewlines, scanInt,
+// scanFloat and profile counter, after which the __init functions run in module
+// order, followed by main. Values are not type checked at run time like civvm
+// --check does, and arrays live until the run ends.
+RunResult RunAssembly(const std::vector<std::string>& modules);
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "lambda_lifting.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+struct FreeVariable
+{
+	NodePtr dec;
+	std::string name;
+	Type type;
+};
+
+struct LiftContext
+{
+	std::shared_ptr<Root> root;
+	std::map<NodePtr, NodePtr> parents, owners;
+	// Variables written by a function other than the one declaring them
+	std::set<std::pair<NodePtr, std::string>> sharedWrites;
+	std::vector<std::shared_ptr<Call>> calls;
+};
+
+NodePtr DeclaringFunction(NodePtr dec, LiftContext& context)
+{
+	return dec->IsFamily<FunctionDef>() ? dec : context.owners[dec];
+}
+
+bool IsArrayVariable(NodePtr dec, const std::string& name)
+{
+	auto varDec = StaticCast<VarDec>(dec);
+	if(varDec) return varDec->var.array;
+
+	for(const auto& param : StaticCast<FunctionDef>(dec)->header.params)
+	{
+		if(param.name == name) return !param.dim.empty();
+	}
+	return false;
+}
+
+// Collects the variables of enclosing functions read by a nested function,
+// or returns false when the function can not be lifted
+bool FreeVariables(std::shared_ptr<FunctionDef> funDef, LiftContext& context, std::vector<FreeVariable>& free)
+{
+	bool liftable = true;
+	std::set<std::pair<NodePtr, std::string>> seen;
+	std::set<std::string> names;
+
+	TraverseBreadth(funDef, [&](NodePtr node, NodePtr)
+	{
+		if(node == funDef) return;
+		if(node->IsFamily<FunctionDef>() || node->IsFamily<ArrayExpr>() || node->IsFamily<AllocateArray>()) liftable = false;
+
+		auto call = StaticCast<Call>(node);
+		if(call && call->dec != funDef && call->dec->IsFamily<FunctionDef>() && !context.parents[call->dec]->IsFamily<Root>()) liftable = false;
+
+		auto assign = StaticCast<Assignment>(node);
+		if(assign && (assign->dec->IsFamily<VarDec>() || assign->dec->IsFamily<FunctionDef>()))
+		{
+			if(DeclaringFunction(assign->dec, context) != funDef) liftable = false;
+		}
+
+		auto id = StaticCast<Identifier>(node);
+		if(!id || !(id->dec->IsFamily<VarDec>() || id->dec->IsFamily<FunctionDef>())) return;
+		if(DeclaringFunction(id->dec, context) == funDef) return;
+
+		auto key = std::make_pair(id->dec, id->name);
+		if(context.sharedWrites.count(key) || IsArrayVariable(id->dec, id->name)) liftable = false;
+		if(!seen.insert(key).second) return;
+
+		// Shadowed variables of different functions would get the same parameter name
+		if(!names.insert(id->name).second) liftable = false;
+		free.push_back({ id->dec, id->name, id->type });
+	});
+
+	return liftable;
+}
+
+void Lift(std::shared_ptr<FunctionDef> funDef, const std::vector<FreeVariable>& free, LiftContext& context)
+{
+	for(const auto& var : free)
+	{
+		Param param;
+		param.type = var.type;
+		param.name = "_C_" + var.name;
+		param.pos = funDef->header.pos;
+		param.line = funDef->header.line;
+		funDef->header.params.push_back(param);
+	}
+
+	std::set<NodePtr> inside;
+	TraverseBreadth(funDef, [&](NodePtr node, NodePtr)
+	{
+		inside.insert(node);
+
+		auto id = StaticCast<Identifier>(node);
+		if(!id) return;
+
+		for(const auto& var : free)
+		{
+			if(id->dec != var.dec || id->name != var.name) continue;
+			id->dec = funDef;
+			id->name = "_C_" + var.name;
+			break;
+		}
+	});
+
+	for(auto call : context.calls)
+	{
+		if(call->dec != funDef) continue;
+
+		for(const auto& var : free)
+		{
+			bool self = inside.count(call) > 0;
+			auto arg = std::make_shared<Identifier>(self ? "_C_" + var.name : var.name);
+			arg->dec = self ? funDef : var.dec;
+			arg->type = var.type;
+			call->children.push_back(arg);
+		}
+	}
+
+	auto& siblings = context.parents[funDef]->children;
+	siblings.erase(std::find(siblings.begin(), siblings.end(), funDef));
+	context.root->children.push_back(funDef);
+}
+
+void LiftNestedFunctions(NodePtr root, Statistics& statistics)
+{
+	int lifted = 0;
+	bool changed = true;
+
+	// Lifting a function can make the function around it liftable
+	while(changed)
+	{
+		changed = false;
+
+		LiftContext context;
+		context.root = StaticCast<Root>(root);
+		if(!context.root) return;
+
+		std::vector<std::shared_ptr<FunctionDef>> nested;
+		TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr parent)
+		{
+			if(parent && parent->IsFamily<FunctionDef>()) nested.push_back(funDef);
+			TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+			{
+				context.owners[node] = funDef;
+			});
+		});
+
+		TraverseBreadth(root, [&](NodePtr node, NodePtr parent)
+		{
+			context.parents[node] = parent;
+
+			auto call = StaticCast<Call>(node);
+			if(call) context.calls.push_back(call);
+		});
+
+		TraverseBreadth<Assignment>(root, [&](std::shared_ptr<Assignment> assign, NodePtr)
+		{
+			if(!assign->dec->IsFamily<VarDec>() && !assign->dec->IsFamily<FunctionDef>()) return;
+			if(context.owners[assign] != DeclaringFunction(assign->dec, context)) context.sharedWrites.insert({ assign->dec, assign->name });
+		});
+
+		std::vector<std::pair<std::shared_ptr<FunctionDef>, std::vector<FreeVariable>>> candidates;
+		for(auto funDef : nested)
+		{
+			std::vector<FreeVariable> free;
+			if(FreeVariables(funDef, context, free)) candidates.push_back({ funDef, free });
+		}
+
+		for(const auto& candidate : candidates) Lift(candidate.first, candidate.second, context);
+
+		lifted += (int)candidates.size();
+		changed = !candidates.empty();
+	}
+
+	statistics["lambda_lifting.lifted"] += lifted;
+}
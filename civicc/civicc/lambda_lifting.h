@@ -0,0 +1,13 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Moves nested functions to the top level when they call only top-level
+// functions and only read variables of the functions around them, and only
+// if no nested function writes those variables. The values they read are
+// passed as extra _C_ parameters, so calls to them become isrg and their
+// reads become plain local loads. Lifted functions are counted under
+// "lambda_lifting.lifted".
+void LiftNestedFunctions(Nodes::NodePtr root, Statistics& statistics);
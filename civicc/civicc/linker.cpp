@@ -0,0 +1,192 @@
+#include <map>
+#include <sstream>
+
+#include "linker.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+static std::string SymbolName(NodePtr node)
+{
+	auto funDef = StaticCast<FunctionDef>(node);
+	if(funDef) return funDef->header.name;
+
+	auto funDec = StaticCast<FunctionDec>(node);
+	if(funDec) return funDec->header.name;
+
+	auto globalDef = StaticCast<GlobalDef>(node);
+	if(globalDef) return globalDef->var.name;
+
+	auto globalDec = StaticCast<GlobalDec>(node);
+	if(globalDec) return globalDec->param.name;
+
+	return "";
+}
+
+static bool IsInit(NodePtr node)
+{
+	auto funDef = StaticCast<FunctionDef>(node);
+	return funDef && funDef->header.name == "__init";
+}
+
+// Whether the node is a definition, and if so whether it is exported
+static bool IsDefinition(NodePtr node, bool& exported)
+{
+	auto funDef = StaticCast<FunctionDef>(node);
+	auto globalDef = StaticCast<GlobalDef>(node);
+	exported = (funDef && funDef->exp) || (globalDef && globalDef->exp);
+	return (funDef && !IsInit(node)) || globalDef;
+}
+
+static bool SameHeader(const FunctionHeader& a, const FunctionHeader& b)
+{
+	if(a.returnType != b.returnType || a.params.size() != b.params.size()) return false;
+
+	for(size_t i = 0; i < a.params.size(); ++i)
+	{
+		if(a.params[i].type != b.params[i].type || a.params[i].dim.size() != b.params[i].dim.size()) return false;
+	}
+	return true;
+}
+
+// Whether an extern declaration can be resolved to the definition exported under its name
+static bool Matches(NodePtr dec, NodePtr def)
+{
+	auto funDec = StaticCast<FunctionDec>(dec);
+	auto funDef = StaticCast<FunctionDef>(def);
+	if(funDec) return funDef && SameHeader(funDec->header, funDef->header);
+
+	auto globalDec = StaticCast<GlobalDec>(dec);
+	auto globalDef = StaticCast<GlobalDef>(def);
+	return globalDef && globalDec->param.type == globalDef->var.type && globalDec->param.dim.empty() != globalDef->var.array;
+}
+
+bool LinkModules(const std::vector<NodePtr>& modules, NodePtr root, std::ostream& diagnostics, Statistics& statistics)
+{
+	std::map<std::string, NodePtr> exports;
+	std::map<std::string, int> definitions;
+	bool success = true;
+
+	for(auto module : modules)
+	{
+		for(auto node : module->children)
+		{
+			bool exported;
+			if(!IsDefinition(node, exported)) continue;
+
+			auto name = SymbolName(node);
+			definitions[name]++;
+			if(exported && !exports.insert({ name, node }).second)
+			{
+				diagnostics << "Multiple modules export " << name << "\n";
+				success = false;
+			}
+		}
+	}
+	if(!success) return false;
+
+	// Declarations that are replaced by a definition or by the first declaration of the same extern
+	std::map<NodePtr, NodePtr> resolved;
+	std::map<std::string, NodePtr> imports;
+	int functions = 0, globals = 0, renamed = 0;
+
+	for(auto module : modules)
+	{
+		for(auto node : module->children)
+		{
+			if(!node->IsFamily<FunctionDec>() && !node->IsFamily<GlobalDec>()) continue;
+
+			auto name = SymbolName(node);
+			auto def = exports.find(name);
+			if(def == exports.end())
+			{
+				auto import = imports.insert({ name, node });
+				if(!import.second) resolved[node] = import.first->second;
+				continue;
+			}
+
+			if(!Matches(node, def->second))
+			{
+				diagnostics << "Extern " << name << " does not match its exported definition\n";
+				success = false;
+				continue;
+			}
+
+			resolved[node] = def->second;
+			if(node->IsFamily<FunctionDec>()) functions++;
+			else globals++;
+		}
+	}
+	if(!success) return false;
+
+	for(size_t i = 0; i < modules.size(); ++i)
+	{
+		for(auto node : modules[i]->children)
+		{
+			bool exported;
+			if(!IsDefinition(node, exported) || exported) continue;
+
+			auto name = SymbolName(node);
+			if(definitions[name] == 1 && !exports.count(name) && !imports.count(name)) continue;
+
+			std::stringstream sstream;
+			sstream << "_M" << i << "_" << name;
+
+			auto funDef = StaticCast<FunctionDef>(node);
+			if(funDef)
+			{
+				funDef->header.name = sstream.str();
+				TraverseNot<FunctionDef>(funDef, [&](NodePtr child, NodePtr)
+				{
+					auto ret = StaticCast<Return>(child);
+					if(ret) ret->functionName = funDef->header.name;
+				});
+			}
+			else StaticCast<GlobalDef>(node)->var.name = sstream.str();
+			renamed++;
+		}
+	}
+
+	auto redirect = [&](NodePtr& dec)
+	{
+		auto it = resolved.find(dec);
+		if(it != resolved.end()) dec = it->second;
+		return SymbolName(dec);
+	};
+
+	for(auto module : modules)
+	{
+		TraverseBreadth(module, [&](NodePtr node, NodePtr)
+		{
+			auto call = StaticCast<Call>(node);
+			if(call && call->dec) call->name = redirect(call->dec);
+
+			auto id = StaticCast<Identifier>(node);
+			if(id && id->dec && (id->dec->IsFamily<GlobalDef>() || id->dec->IsFamily<GlobalDec>())) id->name = redirect(id->dec);
+
+			auto assign = StaticCast<Assignment>(node);
+			if(assign && assign->dec && (assign->dec->IsFamily<GlobalDef>() || assign->dec->IsFamily<GlobalDec>())) assign->name = redirect(assign->dec);
+		});
+	}
+
+	auto init = std::make_shared<FunctionDef>();
+	init->exp = true;
+	init->header.name = "__init";
+	init->header.returnType = Type::Void;
+
+	for(auto module : modules)
+	{
+		for(auto node : module->children)
+		{
+			if(IsInit(node)) init->children.insert(init->children.end(), node->children.begin(), node->children.end());
+			else if(!resolved.count(node)) root->children.push_back(node);
+		}
+	}
+	if(!init->children.empty()) root->children.push_back(init);
+
+	statistics["linker.functions"] += functions;
+	statistics["linker.globals"] += globals;
+	statistics["linker.renamed"] += renamed;
+	return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Links the analysed modules of a whole program into root, in module order.
+// Externs that another module exports are resolved to the definition: calls
+// go to the function directly and extern globals are accessed directly instead
+// of through the getters and setters of CreateGettersSetters. Externs that no
+// module exports, like those of the runtime, are declared once. A symbol a
+// module does not export is renamed to _M<module>_<name> when the name is also
+// defined or imported by another module. The __init functions are merged into
+// one that initialises the modules in order. Returns false after reporting the
+// problem when two modules export the same name or an extern does not match
+// the definition it resolves to. Resolved externs are counted under
+// "linker.functions" and "linker.globals", renamed symbols under "linker.renamed".
+bool LinkModules(const std::vector<Nodes::NodePtr>& modules, Nodes::NodePtr root, std::ostream& diagnostics, Statistics& statistics);
@@ -0,0 +1,84 @@
+#include <sstream>
+
+#include "listing.h"
+
+
+bool AsmLine::IsInstruction(const std::string& mnemonic) const
+{
+	return kind == Instruction && text == mnemonic;
+}
+
+bool AsmLine::IsLabel(const std::string& name) const
+{
+	return kind == Label && text == name;
+}
+
+std::string AsmLine::ToString() const
+{
+	if(kind == Label) return text + ":";
+	if(kind != Instruction) return text;
+
+	std::string str = "\t" + text;
+	for(const auto& arg : args) str += " " + arg;
+	return str;
+}
+
+Listing ParseListing(const std::string& assembly)
+{
+	Listing listing;
+	std::stringstream sstream(assembly);
+	std::string line;
+
+	while(std::getline(sstream, line))
+	{
+		AsmLine asmLine;
+		auto first = line.find_first_not_of(" \t");
+
+		if(first == std::string::npos)
+		{
+			asmLine.kind = AsmLine::Empty;
+		}
+		else if(line[first] == '.')
+		{
+			asmLine.kind = AsmLine::Directive;
+			asmLine.text = line;
+		}
+		else if(line[first] == ';')
+		{
+			asmLine.kind = AsmLine::Comment;
+			asmLine.text = line;
+		}
+		else if(line.back() == ':')
+		{
+			asmLine.kind = AsmLine::Label;
+			asmLine.text = line.substr(first, line.size() - first - 1);
+		}
+		else
+		{
+			std::stringstream words(line);
+			std::string word;
+
+			asmLine.kind = AsmLine::Instruction;
+			words >> asmLine.text;
+			while(words >> word) asmLine.args.push_back(word);
+		}
+
+		listing.push_back(asmLine);
+	}
+
+	return listing;
+}
+
+std::string ListingToString(const Listing& listing)
+{
+	std::string str;
+	for(const auto& line : listing) str += line.ToString() + '\n';
+	return str;
+}
+
+int CountInstructions(const Listing& listing)
+{
+	int count = 0;
+	for(const auto& line : listing) if(line.kind == AsmLine::Instruction) count++;
+	return count;
+}
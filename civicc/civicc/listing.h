@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// One line of generated assembly. Instructions are split into their mnemonic
+// and operands so passes can match on them, everything else is kept verbatim.
+struct AsmLine
+{
+	enum Kind
+	{
+		Empty,
+		Label,
+		Instruction,
+		Directive,
+		Comment
+	};
+
+	Kind kind;
+	// Label name, mnemonic or the verbatim directive/comment
+	std::string text;
+	std::vector<std::string> args;
+
+	bool IsInstruction(const std::string& mnemonic) const;
+	bool IsLabel(const std::string& name) const;
+	std::string ToString() const;
+};
+
+typedef std::vector<AsmLine> Listing;
+
+Listing ParseListing(const std::string& assembly);
+std::string ListingToString(const Listing& listing);
+int CountInstructions(const Listing& listing);
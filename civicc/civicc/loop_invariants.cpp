@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "loop_invariants.h"
+#include "assembly.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+// Fewest instructions an expression must have to be worth a local, one of
+// which is the load that replaces it
+static const int HoistMinimumSize = 3;
+
+typedef std::pair<NodePtr, std::string> VariableId;
+
+struct InvariantOccurrence
+{
+	NodePtr parent;
+	size_t index;
+};
+
+struct LoopInvariants
+{
+	std::set<VariableId> written;
+	bool hasCall = false;
+	// Keys in the order they were first found, so the output does not depend on addresses
+	std::vector<std::string> keys;
+	std::map<std::string, std::vector<InvariantOccurrence>> occurrences;
+};
+
+struct FunctionInvariants
+{
+	// Variables that only this function can read or write, so calls can not change them
+	std::set<VariableId> privateVars;
+	std::set<NodePtr> hoistedVars;
+	std::vector<NodePtr> temporaries;
+	int& counter;
+	int hoisted = 0;
+
+	FunctionInvariants(int& counter) : counter(counter) {}
+};
+
+// Returns a key that is equal for invariant expressions with equal values, or
+// an empty string when the expression may change while the loop runs
+static std::string InvariantKey(NodePtr node, const FunctionInvariants& function, const LoopInvariants& loop)
+{
+	std::stringstream sstream;
+
+	auto literal = StaticCast<Literal>(node);
+	if(literal)
+	{
+		uint32_t bits = 0;
+		if(literal->type == Type::Float) std::memcpy(&bits, &literal->floatValue, sizeof(bits));
+		else bits = literal->type == Type::Int ? (uint32_t)literal->intValue : literal->boolValue;
+
+		sstream << 'l' << (int)literal->type << ':' << bits;
+		return sstream.str();
+	}
+
+	auto id = StaticCast<Identifier>(node);
+	if(id)
+	{
+		// Array elements can be written through other names
+		if(!id->children.empty()) return "";
+
+		VariableId var(id->dec, id->name);
+		if(loop.written.count(var)) return "";
+		if(loop.hasCall && !function.privateVars.count(var)) return "";
+
+		sstream << 'v' << id->dec.get() << id->name;
+		return sstream.str();
+	}
+
+	auto binOp = StaticCast<BinaryOp>(node);
+	auto unOp = StaticCast<UnaryOp>(node);
+	auto cast = StaticCast<Cast>(node);
+	if(!binOp && !unOp && !cast) return "";
+
+	// Hoisting a division out of a branch of the loop could make it trap
+	if(binOp && (binOp->op == Operator::Divide || binOp->op == Operator::Modulo)) return "";
+
+	std::vector<std::string> keys;
+	for(auto child : node->children)
+	{
+		keys.push_back(InvariantKey(child, function, loop));
+		if(keys.back().empty()) return "";
+	}
+
+	if(binOp)
+	{
+		bool commutative = binOp->op == Operator::Add || binOp->op == Operator::Multiply ||
+			binOp->op == Operator::Equal || binOp->op == Operator::NotEqual;
+		if(commutative) std::sort(keys.begin(), keys.end());
+
+		sstream << 'b' << (int)binOp->op << '(' << keys[0] << ',' << keys[1] << ')';
+	}
+	else if(unOp) sstream << 'u' << (int)unOp->op << '(' << keys[0] << ')';
+	else sstream << 'c' << (int)cast->type << '(' << keys[0] << ')';
+
+	return sstream.str();
+}
+
+// Records the largest invariant expressions below node that are worth hoisting
+static void FindInvariants(NodePtr node, const FunctionInvariants& function, LoopInvariants& loop)
+{
+	for(size_t i = 0; i < node->children.size(); ++i)
+	{
+		auto child = node->children[i];
+		if(child->IsFamily<FunctionDef>()) continue;
+
+		auto key = InvariantKey(child, function, loop);
+		if(key.empty() || InstructionCount(child) < HoistMinimumSize)
+		{
+			FindInvariants(child, function, loop);
+			continue;
+		}
+
+		if(!loop.occurrences.count(key)) loop.keys.push_back(key);
+		loop.occurrences[key].push_back({ node, i });
+	}
+}
+
+// Collects the loops of a function, inner loops before the loops around them
+static void CollectLoops(NodePtr node, std::vector<std::pair<NodePtr, NodePtr>>& loops)
+{
+	for(auto child : node->children)
+	{
+		if(child->IsFamily<FunctionDef>()) continue;
+
+		CollectLoops(child, loops);
+		if(child->IsFamily<DoWhile>()) loops.push_back({ child, node });
+	}
+}
+
+static void HoistLoop(NodePtr doWhile, NodePtr block, FunctionInvariants& function)
+{
+	LoopInvariants loop;
+	std::vector<std::pair<NodePtr, NodePtr>> assignments;
+	TraverseNot<FunctionDef>(doWhile, [&](NodePtr node, NodePtr parent)
+	{
+		auto assign = StaticCast<Assignment>(node);
+		if(assign) loop.written.insert({ assign->dec, assign->name });
+		if(assign && function.hoistedVars.count(assign->dec)) assignments.push_back({ assign, parent });
+		if(node->IsFamily<Call>()) loop.hasCall = true;
+	});
+
+	// The locals of inner loops are assigned once, with values that may be invariant here too
+	std::vector<NodePtr> hoisted;
+	for(const auto& pair : assignments)
+	{
+		if(InvariantKey(pair.first->children.back(), function, loop).empty()) continue;
+
+		auto& siblings = pair.second->children;
+		siblings.erase(std::find(siblings.begin(), siblings.end(), pair.first));
+		hoisted.push_back(pair.first);
+		function.hoisted++;
+	}
+
+	// ReplaceLoops shares the condition with the if around the loop, which runs before the hoisted code
+	if(block->IsFamily<If>() && block->children[0] == doWhile->children.back())
+	{
+		std::map<NodePtr, NodePtr> clones;
+		doWhile->children.back() = Clone(doWhile->children.back(), clones);
+	}
+
+	FindInvariants(doWhile, function, loop);
+
+	for(const auto& key : loop.keys)
+	{
+		const auto& occurrences = loop.occurrences[key];
+		auto value = occurrences.front().parent->children[occurrences.front().index];
+		auto type = ExpressionType(value);
+
+		std::stringstream name;
+		name << "_H" << function.counter++;
+
+		auto temp = std::make_shared<VarDec>();
+		temp->var.type = type;
+		temp->var.name = name.str();
+		function.temporaries.push_back(temp);
+		function.hoistedVars.insert(temp);
+		function.privateVars.insert({ temp, temp->var.name });
+
+		auto assign = std::make_shared<Assignment>(temp->var.name);
+		assign->dec = temp;
+		assign->type = type;
+		assign->children.push_back(value);
+		hoisted.push_back(assign);
+
+		for(const auto& occurrence : occurrences)
+		{
+			auto id = std::make_shared<Identifier>(temp->var.name);
+			id->dec = temp;
+			id->type = type;
+			occurrence.parent->children[occurrence.index] = id;
+		}
+		function.hoisted += (int)occurrences.size();
+	}
+
+	auto it = std::find(block->children.begin(), block->children.end(), doWhile);
+	block->children.insert(it, hoisted.begin(), hoisted.end());
+}
+
+void HoistLoopInvariants(NodePtr root, Statistics& statistics)
+{
+	std::map<NodePtr, NodePtr> owner;
+	std::set<VariableId> captured;
+	int counter = 0, hoisted = 0, temporaries = 0;
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		owner[funDef] = funDef;
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			owner[node] = funDef;
+		});
+	});
+
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		auto id = StaticCast<Identifier>(node);
+		if(id && owner[id] != owner[id->dec]) captured.insert({ id->dec, id->name });
+
+		auto assign = StaticCast<Assignment>(node);
+		if(assign && owner[assign] != owner[assign->dec]) captured.insert({ assign->dec, assign->name });
+	});
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		FunctionInvariants function(counter);
+
+		for(const auto& param : funDef->header.params)
+		{
+			VariableId var(funDef, param.name);
+			if(param.dim.empty() && !captured.count(var)) function.privateVars.insert(var);
+		}
+
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			auto varDec = StaticCast<VarDec>(node);
+			if(!varDec || varDec->var.array) return;
+
+			VariableId var(varDec, varDec->var.name);
+			if(!captured.count(var)) function.privateVars.insert(var);
+		});
+
+		std::vector<std::pair<NodePtr, NodePtr>> loops;
+		CollectLoops(funDef, loops);
+		for(const auto& loop : loops) HoistLoop(loop.first, loop.second, function);
+
+		funDef->children.insert(funDef->children.begin(), function.temporaries.begin(), function.temporaries.end());
+		hoisted += function.hoisted;
+		temporaries += (int)function.temporaries.size();
+	});
+
+	statistics["loop_invariants.hoisted"] += hoisted;
+	statistics["loop_invariants.temporaries"] += temporaries;
+}
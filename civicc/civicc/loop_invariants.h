@@ -0,0 +1,16 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Loop-invariant code motion on the do-while loops ReplaceLoops leaves. An
+// expression inside a loop whose operands the loop does not write is computed
+// once into a fresh _H local right before the loop, which runs at least once
+// from there. Variables that a call could change, globals and variables of
+// enclosing functions, only count as unwritten in loops without calls.
+// Divisions can trap and are never moved. To keep trivial loops from growing
+// their frame, only expressions that save at least two instructions per
+// iteration get a local. Moved expressions are counted under
+// "loop_invariants.hoisted" and the added locals under "loop_invariants.temporaries".
+void HoistLoopInvariants(Nodes::NodePtr root, Statistics& statistics);
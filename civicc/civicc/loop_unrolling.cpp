@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+
+#include "loop_unrolling.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+static int BodySize(std::shared_ptr<For> forLoop)
+{
+	int count = 0;
+	for(auto statement : forLoop->children)
+	{
+		TraverseBreadth(statement, [&](NodePtr, NodePtr) { count++; });
+	}
+	return count;
+}
+
+// SeperateForLoopInduction assigns the induction locals right before the loop
+static std::shared_ptr<Assignment> InductionAssignment(NodePtr parent, NodePtr dec)
+{
+	for(auto node : parent->children)
+	{
+		auto assign = StaticCast<Assignment>(node);
+		if(assign && assign->dec == dec) return assign;
+	}
+	return nullptr;
+}
+
+static std::shared_ptr<Literal> IntLiteral(std::shared_ptr<Assignment> assign)
+{
+	if(!assign) return nullptr;
+
+	auto literal = StaticCast<Literal>(assign->children.back());
+	return literal && literal->type == Type::Int ? literal : nullptr;
+}
+
+static bool FitsInt(long long value)
+{
+	return value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max();
+}
+
+// Appends a copy of the loop body in which value() replaces the induction variable
+static void CopyBody(std::shared_ptr<For> forLoop, std::function<NodePtr()> value, std::vector<NodePtr>& statements)
+{
+	for(auto statement : forLoop->children)
+	{
+		std::map<NodePtr, NodePtr> clones;
+		auto copy = Clone(statement, clones);
+		Replace<Identifier>(copy, [&](std::shared_ptr<Identifier> id) -> NodePtr
+		{
+			return id->dec == forLoop->lower ? value() : id;
+		});
+		statements.push_back(copy);
+	}
+}
+
+static NodePtr InductionOffset(std::shared_ptr<For> forLoop, long long offset)
+{
+	auto id = std::make_shared<Identifier>(forLoop->lower->var.name);
+	id->dec = forLoop->lower;
+	id->type = Type::Int;
+	if(offset == 0) return id;
+
+	auto add = std::make_shared<BinaryOp>(Operator::Add);
+	add->type = Type::Int;
+	add->children.push_back(id);
+	add->children.push_back(std::make_shared<Literal>((int)offset));
+	return add;
+}
+
+void UnrollLoops(NodePtr root, int factor, Statistics& statistics)
+{
+	// Collected first, since unrolling changes the lists the loops are in
+	std::vector<std::pair<std::shared_ptr<For>, NodePtr>> loops;
+	TraverseDepth<For>(root, [&](std::shared_ptr<For> forLoop, NodePtr parent)
+	{
+		loops.push_back({ forLoop, parent });
+	});
+
+	int full = 0, partial = 0;
+
+	for(const auto& loop : loops)
+	{
+		auto forLoop = loop.first;
+		auto& siblings = loop.second->children;
+
+		if(!forLoop->constantStep || forLoop->constantStep->intValue == 0) continue;
+		if(Count<For>(forLoop) > 1 || Count<VarDec>(forLoop) > 0) continue;
+
+		auto upperAssign = InductionAssignment(loop.second, forLoop->upper);
+		auto lower = IntLiteral(InductionAssignment(loop.second, forLoop->lower));
+		auto upper = IntLiteral(upperAssign);
+		if(!lower || !upper) continue;
+
+		long long first = lower->intValue, last = upper->intValue, step = forLoop->constantStep->intValue;
+		long long trips = 0;
+		if(step > 0 && first < last) trips = (last - first + step - 1) / step;
+		if(step < 0 && first > last) trips = (first - last - step - 1) / -step;
+
+		int size = BodySize(forLoop);
+		auto position = std::find(siblings.begin(), siblings.end(), forLoop);
+
+		if(trips <= FullUnrollLimit && trips * size <= UnrollBudget)
+		{
+			std::vector<NodePtr> statements;
+			for(long long i = 0; i < trips; ++i)
+			{
+				CopyBody(forLoop, [&]() { return std::make_shared<Literal>((int)(first + i * step)); }, statements);
+			}
+
+			position = siblings.erase(position);
+			siblings.insert(position, statements.begin(), statements.end());
+			full++;
+			continue;
+		}
+
+		if(factor < 2 || trips < factor || factor * size > UnrollBudget) continue;
+
+		long long unrolled = trips / factor * factor;
+		long long end = first + unrolled * step;
+		if(!FitsInt(end) || !FitsInt(step * factor)) continue;
+
+		std::vector<NodePtr> body, remainder;
+		for(long long i = 0; i < factor; ++i)
+		{
+			CopyBody(forLoop, [&]() { return InductionOffset(forLoop, i * step); }, body);
+		}
+		for(long long i = unrolled; i < trips; ++i)
+		{
+			CopyBody(forLoop, [&]() { return std::make_shared<Literal>((int)(first + i * step)); }, remainder);
+		}
+
+		forLoop->children = body;
+		forLoop->constantStep = std::make_shared<Literal>((int)(step * factor));
+		upperAssign->children.back() = std::make_shared<Literal>((int)end);
+
+		siblings.insert(position + 1, remainder.begin(), remainder.end());
+		partial++;
+	}
+
+	statistics["loop_unrolling.full"] += full;
+	statistics["loop_unrolling.partial"] += partial;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Most iterations a loop is fully unrolled for
+const int FullUnrollLimit = 8;
+// Most nodes the body of an unrolled loop may grow to
+const int UnrollBudget = 160;
+
+// Unrolls for loops whose bounds and step are integer literals, before
+// ReplaceLoops turns them into while loops. Only innermost loops, whose body
+// declares no induction locals of its own, are unrolled. Loops of at most
+// FullUnrollLimit iterations are replaced by a copy of the body per iteration
+// with the induction variable replaced by its value. Longer loops run factor
+// copies of the body per iteration, the induction variable offset by the
+// step in each, and the iterations that remain are appended as copies.
+// Unrolling stops at UnrollBudget nodes of body. A factor below 2 disables
+// partial unrolling. Unrolled loops are counted under "loop_unrolling.full"
+// and "loop_unrolling.partial".
+void UnrollLoops(Nodes::NodePtr root, int factor, Statistics& statistics);
@@ -1,33 +1,61 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include <cstring>
+#include <cstdlib>
 
-#include "tokenizer.h"
-#include "parser.h"
-#include "instruction.h"
-#include "node.h"
-#include "traverse.h"
-#include "symboltable.h"
-#include "seperation.h"
-#include "replace_boolops.h"
-#include "analysis.h"
-#include "assembly.h"
-#include "nested_func_renaming.h"
-#include "replace_loops.h"
-#include "global_getset.h"
+#include "compiler.h"
+#include "server.h"
+#include "batch.h"
 
 int main(int argc, char* argv[])
 {
-	std::string inputFilename, outputFilename;
-	bool verbose = false;
+	std::string outputFilename, socketPath = DefaultSocketPath();
+	std::vector<std::string> inputFilenames;
+	CompileOptions options;
+	bool server = false, useServer = true, printStatistics = false, wholeProgram = false;
+	unsigned workers = std::thread::hardware_concurrency(), jobs = 1;
+	size_t cacheSize = 256;
 	
 	for(int i = 1; i < argc; ++i)
 	{
-		if(strcmp(argv[i], "-v") == 0) verbose = true;
+		if(strcmp(argv[i], "-v") == 0) options.verbose = true;
+		else if(strncmp(argv[i], "-O", 2) == 0 && argv[i][2] != '\0') options.optimisationLevel = std::atoi(argv[i] + 2);
+		else if(strcmp(argv[i], "--stats") == 0) printStatistics = true;
+		else if(strcmp(argv[i], "--emit-c") == 0) options.backend = Backend::C;
+		else if(strcmp(argv[i], "--emit-native") == 0) options.backend = Backend::Native;
+		else if(strcmp(argv[i], "--instrument") == 0) options.instrument = true;
+		else if(strcmp(argv[i], "--whole-program") == 0) wholeProgram = true;
+		else if(strncmp(argv[i], "--eval-steps=", 13) == 0) options.evaluationBudget.steps = std::atoi(argv[i] + 13);
+		else if(strncmp(argv[i], "--eval-depth=", 13) == 0) options.evaluationBudget.depth = std::atoi(argv[i] + 13);
+		else if(strncmp(argv[i], "--specialise-growth=", 20) == 0) options.specialisationGrowth = std::atoi(argv[i] + 20);
+		else if(strncmp(argv[i], "--unroll=", 9) == 0) options.unrollFactor = std::atoi(argv[i] + 9);
+		else if(strncmp(argv[i], "--profile-use=", 14) == 0)
+		{
+			std::ifstream profile(argv[i] + 14);
+			if(!profile.is_open() || !ReadProfile(profile, options.profile))
+			{
+				std::cout << "Could not read profile " << argv[i] + 14 << '\n';
+				return -1;
+			}
+		}
+		else if(strncmp(argv[i], "-march=", 7) == 0)
+		{
+			if(strcmp(argv[i] + 7, "x86-64") != 0)
+			{
+				std::cout << "Unsupported architecture " << argv[i] + 7 << ", only x86-64 is supported.\n";
+				return -1;
+			}
+		}
 		else if(strcmp(argv[i], "--help") == 0)
 		{
-			std::cout << "civicc [-v] [-o <file>] [<file>]\n";
+			std::cout << "civicc [-v] [-O<level>] [--stats] [--emit-c] [--emit-native [-march=x86-64]] [--instrument] [--profile-use=<file>] [--eval-steps=<n>] [--eval-depth=<n>] [--specialise-growth=<percent>] [--unroll=<factor>] [-o <file>] [--no-server] [--socket <path>] [<file>]\n";
+			std::cout << "civicc [-v] [-O<level>] [--stats] [--emit-c] [--emit-native [-march=x86-64]] [--instrument] [--profile-use=<file>] [--eval-steps=<n>] [--eval-depth=<n>] [--specialise-growth=<percent>] [--unroll=<factor>] [-j <jobs>] [-o <directory>] <file> <file>...\n";
+			std::cout << "civicc [-v] [-O<level>] [--stats] [--emit-c] [--emit-native [-march=x86-64]] --whole-program [-o <file>] <file> <file>...\n";
+			std::cout << "civicc --server [--socket <path>] [--workers <n>] [--cache <entries>]\n";
+			return 0;
 		}
 		else if(strcmp(argv[i], "-o") == 0)
 		{
@@ -38,82 +66,72 @@ int main(int argc, char* argv[])
 			}
 			outputFilename = argv[++i];
 		}
-		else
+		else if(strcmp(argv[i], "--server") == 0) server = true;
+		else if(strcmp(argv[i], "--no-server") == 0) useServer = false;
+		else if(strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--socket") == 0 || strcmp(argv[i], "--workers") == 0 || strcmp(argv[i], "--cache") == 0)
 		{
-			if(inputFilename.empty()) inputFilename = argv[i];
+			if(i + 1 >= argc)
+			{
+				std::cout << "No value supplied for " << argv[i] << ".\n";
+				return -1;
+			}
+			if(strcmp(argv[i], "-j") == 0) jobs = std::atoi(argv[++i]);
+			else if(strcmp(argv[i], "--socket") == 0) socketPath = argv[++i];
+			else if(strcmp(argv[i], "--workers") == 0) workers = std::atoi(argv[++i]);
+			else cacheSize = std::atoi(argv[++i]);
 		}
+		else inputFilenames.push_back(argv[i]);
 	}
+
+	if(server) return RunServer(socketPath, workers, cacheSize);
 	
-	if(inputFilename.empty())
+	if(inputFilenames.empty())
 	{
 		std::cout << "No input file supplied.\n";
 		return -1;
 	}
 
-	std::ifstream file(inputFilename);
-	Tokenizer tokenizer(file);
-	Token token;
-	std::vector<Token> tokens;
-	Parser parser(tokens);
-	AssemblyGenerator assemblyGenerator;
+	if(inputFilenames.size() > 1 && !wholeProgram) return CompileBatch(inputFilenames, outputFilename, jobs, options, printStatistics);
 
-	if(file.is_open())
+	std::vector<ModuleSource> modules;
+	for(const auto& inputFilename : inputFilenames)
 	{
-		try{ while(tokenizer.GetNextToken(token)) tokens.push_back(token); }
-		catch(int line)
+		std::ifstream file(inputFilename);
+		if(!file.is_open())
 		{
-			std::cout << "Integer value out of range at line " << line << "\n";
+			std::cout << "Could not read " << inputFilename << '\n';
 			return -1;
 		}
+
+		std::stringstream source;
+		source << file.rdbuf();
 		file.close();
+		modules.push_back({ inputFilename, source.str() });
 	}
 
-	try
-	{
-		auto root = std::make_shared<Nodes::Root>();
-		parser.ParseProgram(root);
-
-		SeperateDecAndInit(root);
-		if(verbose) std::cout << "AST before:\n" << TreeToJSON(root) << "\n";
-
-		auto errors = Analyzer().Analyse(root);
-		std::cout << errors;
-		if(errors.size() > 0) return -1;
-
-		ReplaceBooleanOperators(root);
-		ReplaceLoops(root);
-		RenameNestedFunctions(root);
-		CreateGettersSetters(root);
+	CompileResult result;
+	if(wholeProgram) result = CompileProgram(modules, options);
+	else if(!useServer || !CompileRemote(socketPath, modules[0].source, options, result)) result = Compile(modules[0].source, options);
 
-		std::string assembly = assemblyGenerator.Generate(root);
-		if(verbose)
-		{
-			std::cout << "AST after:\n" << TreeToJSON(root) << "\n";
-			std::cout << "-------------------------------------\n";
-			std::cout << "Assembly\n";
-			std::cout << "-------------------------------------\n";
-			std::cout << assembly << "\n";
-		}
+	// Warnings of a successful compile must not end up in assembly written to stdout
+	std::cout << result.log;
+	(result.success ? std::cerr : std::cout) << result.diagnostics;
+	if(printStatistics) std::cerr << StatisticsToString(result.statistics);
+	if(!result.success) return -1;
 
-		if(outputFilename.empty())
-		{
-			if(!verbose)std::cout << assembly;
-		}
-		else
-		{
-			std::ofstream output(outputFilename, std::ios::out | std::ios::trunc);
-			if(output.is_open())
-			{
-				output << assembly;
-				output.close();
-			}
-			else std::cout << "Could not write to " << outputFilename << '\n';
-		}
+	if(outputFilename.empty())
+	{
+		if(!options.verbose) std::cout << result.assembly;
 	}
-	catch(ParseException e)
+	else
 	{
-		std::cout << e.what();
-		return -1;
+		std::ofstream output(outputFilename, std::ios::out | std::ios::trunc);
+		if(output.is_open())
+		{
+			output << result.assembly;
+			output.close();
+		}
+		else std::cout << "Could not write to " << outputFilename << '\n';
 	}
 
 	return 0;
@@ -0,0 +1,508 @@
+#include <cstring>
+
+#include "native_generator.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+static const char* const temporaryRegisters[] = { "%rbx", "%r12", "%r13", "%r14", "%r15" };
+static const int temporaryRegisterCount = 5;
+static const char* const intArgRegisters[] = { "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9" };
+static const int intArgRegisterCount = 6;
+static const int floatArgRegisterCount = 8;
+
+// Offset from %rbp of a frame slot, the five callee-saved registers being pushed right below it
+static std::string Slot(int slot)
+{
+	return std::to_string(-48 - 8 * slot) + "(%rbp)";
+}
+
+static bool IsMemory(const std::string& operand)
+{
+	return operand.find('(') != std::string::npos;
+}
+
+static std::string Move(const std::string& src, const std::string& dst)
+{
+	if(src == dst) return "";
+	if(IsMemory(src) && IsMemory(dst)) return "\tmovq " + src + ", %r11\n\tmovq %r11, " + dst + "\n";
+	return "\tmovq " + src + ", " + dst + "\n";
+}
+
+static std::string FloatRegister(int index)
+{
+	return "%xmm" + std::to_string(index);
+}
+
+// Whether a parameter of this type is passed in a vector register
+static bool IsFloatParam(const Param& param)
+{
+	return param.type == Type::Float && param.dim.empty();
+}
+
+static std::string FunctionLabel(const std::string& name, const char* suffix)
+{
+	return ".L" + name + suffix;
+}
+
+std::string NativeGenerator::Generate(NodePtr root)
+{
+	std::vector<std::shared_ptr<FunctionDef>> functions;
+	TraverseBreadth(root, [&](NodePtr node, NodePtr parent)
+	{
+		auto funDef = StaticCast<FunctionDef>(node);
+		if(!funDef) return;
+
+		functions.push_back(funDef);
+		if(parent->IsFamily<FunctionDef>()) owners[funDef] = parent;
+
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr child, NodePtr)
+		{
+			owners[child] = funDef;
+		});
+	});
+
+	std::stringstream sstream;
+	sstream << "\t.text\n";
+	for(auto funDef : functions)
+	{
+		text.str("");
+		FunDef(funDef);
+		sstream << text.str();
+	}
+
+	bool globals = false;
+	for(auto child : root->children)
+	{
+		auto globalDef = StaticCast<GlobalDef>(child);
+		if(!globalDef) continue;
+
+		if(!globals) sstream << "\n\t.bss\n\t.balign 8\n";
+		globals = true;
+		sstream << ".Lglobal_" << globalDef->var.name << ":\n\t.zero 8\n";
+	}
+
+	for(auto funDef : functions)
+	{
+		if(funDef->header.name != "__init") continue;
+		sstream << "\n\t.section .init_array, \"aw\"\n\t.balign 8\n\t.quad " << funDef->header.name << '\n';
+	}
+
+	sstream << "\n\t.section .note.GNU-stack, \"\", @progbits\n";
+	return sstream.str();
+}
+
+std::string NativeGenerator::Label()
+{
+	return ".L" + std::to_string(labelCounter++);
+}
+
+std::string NativeGenerator::Temp(int depth)
+{
+	if(depth + 1 > maxDepth) maxDepth = depth + 1;
+	if(depth < temporaryRegisterCount) return temporaryRegisters[depth];
+	return Slot(firstSpillSlot + depth - temporaryRegisterCount);
+}
+
+// Operand of a variable, which may use %rax to reach the frame of an enclosing function
+std::string NativeGenerator::Location(NodePtr dec, const std::string& name)
+{
+	if(dec->IsFamily<GlobalDef>()) return ".Lglobal_" + name + "(%rip)";
+
+	int slot;
+	NodePtr owner;
+	if(dec->IsFamily<FunctionDef>())
+	{
+		owner = dec;
+		slot = paramSlots.at(dec).at(name);
+	}
+	else
+	{
+		owner = owners.at(dec);
+		slot = slots.at(dec);
+	}
+
+	if(owner == function) return Slot(slot);
+
+	StaticLink(owner, "%rax");
+	return std::to_string(-48 - 8 * slot) + "(%rax)";
+}
+
+// Loads the frame pointer of owner, which is the current function or encloses it.
+// Slot 0 of the frame of a nested function holds that of its enclosing function.
+void NativeGenerator::StaticLink(NodePtr owner, const std::string& reg)
+{
+	if(owner == function)
+	{
+		text << "\tmovq %rbp, " << reg << '\n';
+		return;
+	}
+
+	text << "\tmovq " << Slot(0) << ", " << reg << '\n';
+	for(auto parent = owners.at(function); parent != owner; parent = owners.at(parent))
+	{
+		text << "\tmovq -48(" << reg << "), " << reg << '\n';
+	}
+}
+
+void NativeGenerator::FunDef(std::shared_ptr<FunctionDef> funDef)
+{
+	function = funDef;
+	maxDepth = 0;
+
+	int slot = 1;
+	for(const auto& param : funDef->header.params) paramSlots[funDef][param.name] = slot++;
+
+	std::vector<int> localSlots;
+	TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+	{
+		if(!node->IsFamily<VarDec>()) return;
+		localSlots.push_back(slot);
+		slots[node] = slot++;
+	});
+	firstSpillSlot = slot;
+
+	// The prologue is finished once the number of spill slots is known
+	std::stringstream prologue;
+	const auto& name = funDef->header.name;
+	prologue << "\n\t.p2align 4\n";
+	if(funDef->exp && name != "__init") prologue << "\t.globl " << name << '\n';
+	prologue << "\t.type " << name << ", @function\n" << name << ":\n";
+	prologue << "\tpushq %rbp\n\tmovq %rsp, %rbp\n";
+	for(auto reg : temporaryRegisters) prologue << "\tpushq " << reg << '\n';
+
+	// Parameters, after the static link in slot 0
+	if(owners.count(funDef)) text << "\tmovq %r10, " << Slot(0) << '\n';
+	int intCount = 0, floatCount = 0, stackCount = 0;
+	for(const auto& param : funDef->header.params)
+	{
+		auto location = Slot(paramSlots[funDef][param.name]);
+		if(IsFloatParam(param) && floatCount < floatArgRegisterCount) text << "\tmovq " << FloatRegister(floatCount++) << ", " << location << '\n';
+		else if(!IsFloatParam(param) && intCount < intArgRegisterCount) text << "\tmovq " << intArgRegisters[intCount++] << ", " << location << '\n';
+		else text << Move(std::to_string(16 + 8 * stackCount++) + "(%rbp)", location);
+	}
+	if(!localSlots.empty()) text << "\txorl %eax, %eax\n";
+	for(int local : localSlots) text << "\tmovq %rax, " << Slot(local) << '\n';
+	text << FunctionLabel(name, "_body") << ":\n";
+
+	for(auto child : funDef->children) Statement(child);
+
+	text << FunctionLabel(name, "_return") << ":\n";
+	if(name == "main" && funDef->header.returnType == Type::Void) text << "\txorl %eax, %eax\n";
+	text << "\tleaq -40(%rbp), %rsp\n";
+	for(int i = temporaryRegisterCount; i-- > 0;) text << "\tpopq " << temporaryRegisters[i] << '\n';
+	text << "\tpopq %rbp\n\tret\n";
+	text << "\t.size " << name << ", .-" << name << '\n';
+
+	// With the return address, %rbp and the five saved registers pushed, an odd
+	// number of slots keeps the stack aligned to 16 bytes at calls
+	int slotCount = firstSpillSlot + (maxDepth > temporaryRegisterCount ? maxDepth - temporaryRegisterCount : 0);
+	if(slotCount % 2 == 0) ++slotCount;
+	prologue << "\tsubq $" << 8 * slotCount << ", %rsp\n";
+
+	auto body = text.str();
+	text.str("");
+	text << prologue.str() << body;
+}
+
+void NativeGenerator::Statement(NodePtr node)
+{
+	auto alloc = StaticCast<AllocateArray>(node);
+	if(alloc) ArrayDec(alloc);
+
+	auto assign = StaticCast<Assignment>(node);
+	if(assign)
+	{
+		Expression(assign->children[0], 0);
+		Store(0, assign->dec, assign->name);
+	}
+
+	auto call = StaticCast<Call>(node);
+	if(call) FunCall(call, 0);
+
+	auto ret = StaticCast<Return>(node);
+	if(ret)
+	{
+		if(!ret->children.empty())
+		{
+			Expression(ret->children[0], 0);
+			if(function->header.returnType == Type::Float) text << "\tmovq " << Temp(0) << ", %xmm0\n";
+			else text << "\tmovq " << Temp(0) << ", %rax\n";
+		}
+		text << "\tjmp " << FunctionLabel(function->header.name, "_return") << '\n';
+	}
+
+	auto ifStatement = StaticCast<If>(node);
+	if(ifStatement)
+	{
+		auto elseStatement = StaticCast<Else>(ifStatement->children.back());
+		size_t end = ifStatement->children.size() - (elseStatement ? 1 : 0);
+		auto elseLabel = Label(), endLabel = Label();
+
+		Expression(ifStatement->children[0], 0);
+		text << "\tcmpq $0, " << Temp(0) << "\n\tje " << elseLabel << '\n';
+		for(size_t i = 1; i < end; ++i) Statement(ifStatement->children[i]);
+
+		if(elseStatement)
+		{
+			text << "\tjmp " << endLabel << '\n' << elseLabel << ":\n";
+			for(auto child : elseStatement->children) Statement(child);
+			text << endLabel << ":\n";
+		}
+		else text << elseLabel << ":\n";
+	}
+
+	auto doWhile = StaticCast<DoWhile>(node);
+	if(doWhile)
+	{
+		auto loop = Label();
+		text << loop << ":\n";
+		for(size_t i = 0; i + 1 < doWhile->children.size(); ++i) Statement(doWhile->children[i]);
+
+		Expression(doWhile->children.back(), 0);
+		text << "\tcmpq $0, " << Temp(0) << "\n\tjne " << loop << '\n';
+	}
+}
+
+// Elements are 8 bytes wide whatever their type. The counter and value locals
+// LowerArrays introduces are not needed, the fill loop keeps both in temporaries.
+void NativeGenerator::ArrayDec(std::shared_ptr<AllocateArray> alloc)
+{
+	const auto& name = alloc->dec->IsFamily<GlobalDef>() ? StaticCast<GlobalDef>(alloc->dec)->var.name : StaticCast<VarDec>(alloc->dec)->var.name;
+
+	Expression(alloc->children[0], 0);
+	text << "\tmovq " << Temp(0) << ", %rdi\n\tmovl $8, %esi\n\tcall civic_alloc@PLT\n";
+	text << "\tmovq %rax, " << Temp(1) << '\n';
+	Store(1, alloc->dec, name);
+
+	if(alloc->children.size() < 2) return;
+	auto init = alloc->children[1];
+
+	if(init->IsFamily<ArrayExpr>())
+	{
+		for(size_t i = 0; i < init->children.size(); ++i)
+		{
+			Expression(init->children[i], 2);
+			text << "\tmovq " << Temp(1) << ", %rcx\n";
+			text << Move(Temp(2), "%r11") << "\tmovq %r11, " << 8 * i << "(%rcx)\n";
+		}
+		return;
+	}
+
+	auto loop = Label(), end = Label();
+	Expression(init, 2);
+	text << "\tmovq " << Temp(1) << ", %rcx\n\tmovq " << Temp(0) << ", %rdx\n" << Move(Temp(2), "%r11");
+	text << loop << ":\n\ttestq %rdx, %rdx\n\tjle " << end << '\n';
+	text << "\tdecq %rdx\n\tmovq %r11, (%rcx,%rdx,8)\n\tjmp " << loop << '\n' << end << ":\n";
+}
+
+void NativeGenerator::Store(int depth, NodePtr dec, const std::string& name)
+{
+	auto location = Location(dec, name);
+	text << Move(Temp(depth), location);
+}
+
+void NativeGenerator::Expression(NodePtr node, int depth)
+{
+	auto result = Temp(depth);
+
+	auto literal = StaticCast<Literal>(node);
+	if(literal)
+	{
+		if(literal->type == Type::Bool) text << "\tmovq $" << (literal->boolValue ? 1 : 0) << ", " << result << '\n';
+		else if(literal->type == Type::Int) text << "\tmovq $" << literal->intValue << ", " << result << '\n';
+		else
+		{
+			// civvm reads float constants in single precision and computes in double
+			double value = literal->floatValue;
+			long long bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			text << "\tmovabsq $" << bits << ", %rax\n" << Move("%rax", result);
+		}
+	}
+
+	auto id = StaticCast<Identifier>(node);
+	if(id) text << Move(Location(id->dec, id->name), result);
+
+	auto call = StaticCast<Call>(node);
+	if(call) FunCall(call, depth);
+
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(binOp) Arithmetic(binOp, depth);
+
+	auto unOp = StaticCast<UnaryOp>(node);
+	if(unOp)
+	{
+		Expression(unOp->children[0], depth);
+		if(unOp->op == Operator::Not) text << "\txorq $1, " << result << '\n';
+		else if(unOp->type == Type::Float) text << "\tmovabsq $0x8000000000000000, %rax\n\txorq %rax, " << result << '\n';
+		else text << "\tnegq " << result << '\n';
+	}
+
+	auto cast = StaticCast<Cast>(node);
+	if(cast)
+	{
+		Expression(cast->children[0], depth);
+		if(cast->type == Type::Float && cast->castFrom != Type::Float)
+		{
+			text << "\tcvtsi2sdq " << result << ", %xmm0\n\tmovq %xmm0, " << result << '\n';
+		}
+		else if(cast->type == Type::Int && cast->castFrom == Type::Float)
+		{
+			text << "\tmovq " << result << ", %xmm0\n\tcvttsd2siq %xmm0, %rax\n" << Move("%rax", result);
+		}
+		else if(cast->type == Type::Bool && cast->castFrom == Type::Float)
+		{
+			text << "\tmovq " << result << ", %xmm0\n\txorpd %xmm1, %xmm1\n\tucomisd %xmm1, %xmm0\n";
+			text << "\tsetne %al\n\tsetp %cl\n\torb %cl, %al\n\tmovzbq %al, %rax\n" << Move("%rax", result);
+		}
+		else if(cast->type == Type::Bool && cast->castFrom == Type::Int)
+		{
+			text << "\tcmpq $0, " << result << "\n\tsetne %al\n\tmovzbq %al, %rax\n" << Move("%rax", result);
+		}
+	}
+
+	auto ternary = StaticCast<Ternary>(node);
+	if(ternary)
+	{
+		auto elseLabel = Label(), end = Label();
+		Expression(ternary->children[0], depth);
+		text << "\tcmpq $0, " << result << "\n\tje " << elseLabel << '\n';
+		Expression(ternary->children[1], depth);
+		text << "\tjmp " << end << '\n' << elseLabel << ":\n";
+		Expression(ternary->children[2], depth);
+		text << end << ":\n";
+	}
+}
+
+void NativeGenerator::Arithmetic(std::shared_ptr<Nodes::BinaryOp> binOp, int depth)
+{
+	auto left = Temp(depth);
+
+	if(binOp->op == Operator::And || binOp->op == Operator::Or)
+	{
+		auto end = Label();
+		Expression(binOp->children[0], depth);
+		text << "\tcmpq $0, " << left << (binOp->op == Operator::And ? "\n\tje " : "\n\tjne ") << end << '\n';
+		Expression(binOp->children[1], depth);
+		text << end << ":\n";
+		return;
+	}
+
+	Expression(binOp->children[0], depth);
+	Expression(binOp->children[1], depth + 1);
+	auto right = Temp(depth + 1);
+
+	if(ExpressionType(binOp->children[0]) == Type::Float)
+	{
+		text << "\tmovq " << left << ", %xmm0\n\tmovq " << right << ", %xmm1\n";
+
+		const char* arithmetic = nullptr;
+		switch(binOp->op)
+		{
+		case Operator::Add: arithmetic = "addsd"; break;
+		case Operator::Subtract: arithmetic = "subsd"; break;
+		case Operator::Multiply: arithmetic = "mulsd"; break;
+		case Operator::Divide: arithmetic = "divsd"; break;
+		default: break;
+		}
+		if(arithmetic)
+		{
+			text << '\t' << arithmetic << " %xmm1, %xmm0\n\tmovq %xmm0, " << left << '\n';
+			return;
+		}
+
+		// Unordered operands compare unequal and neither less nor more
+		switch(binOp->op)
+		{
+		case Operator::Equal: text << "\tucomisd %xmm1, %xmm0\n\tsete %al\n\tsetnp %cl\n\tandb %cl, %al\n"; break;
+		case Operator::NotEqual: text << "\tucomisd %xmm1, %xmm0\n\tsetne %al\n\tsetp %cl\n\torb %cl, %al\n"; break;
+		case Operator::Less: text << "\tucomisd %xmm0, %xmm1\n\tseta %al\n"; break;
+		case Operator::LessEqual: text << "\tucomisd %xmm0, %xmm1\n\tsetae %al\n"; break;
+		case Operator::More: text << "\tucomisd %xmm1, %xmm0\n\tseta %al\n"; break;
+		default: text << "\tucomisd %xmm1, %xmm0\n\tsetae %al\n"; break;
+		}
+		text << "\tmovzbq %al, %rax\n" << Move("%rax", left);
+		return;
+	}
+
+	text << "\tmovq " << left << ", %rax\n";
+	switch(binOp->op)
+	{
+	case Operator::Add: text << "\taddq " << right << ", %rax\n"; break;
+	case Operator::Subtract: text << "\tsubq " << right << ", %rax\n"; break;
+	case Operator::Multiply: text << "\timulq " << right << ", %rax\n"; break;
+	case Operator::Divide: text << "\tcqto\n\tidivq " << right << '\n'; break;
+	case Operator::Modulo: text << "\tcqto\n\tidivq " << right << "\n\tmovq %rdx, %rax\n"; break;
+	default:
+	{
+		const char* condition;
+		switch(binOp->op)
+		{
+		case Operator::Equal: condition = "e"; break;
+		case Operator::NotEqual: condition = "ne"; break;
+		case Operator::Less: condition = "l"; break;
+		case Operator::LessEqual: condition = "le"; break;
+		case Operator::More: condition = "g"; break;
+		default: condition = "ge"; break;
+		}
+		text << "\tcmpq " << right << ", %rax\n\tset" << condition << " %al\n\tmovzbq %al, %rax\n";
+	}
+	}
+	text << Move("%rax", left);
+}
+
+// Arguments are evaluated into the temporaries above depth in CiviC's order,
+// after which they are moved to where the System V ABI expects them
+void NativeGenerator::FunCall(std::shared_ptr<Call> call, int depth)
+{
+	for(size_t i = 0; i < call->children.size(); ++i) Expression(call->children[i], depth + i);
+
+	auto funDef = StaticCast<FunctionDef>(call->dec);
+	auto funDec = StaticCast<FunctionDec>(call->dec);
+	const auto& header = funDef ? funDef->header : funDec->header;
+
+	if(call->tail)
+	{
+		// Reuse the current frame: overwrite the parameters and start over
+		for(size_t i = 0; i < header.params.size(); ++i) text << Move(Temp(depth + i), Slot(paramSlots[funDef][header.params[i].name]));
+		text << "\tjmp " << FunctionLabel(header.name, "_body") << '\n';
+		return;
+	}
+
+	std::vector<std::string> stackArgs;
+	std::stringstream registerArgs;
+	int intCount = 0, floatCount = 0;
+	for(size_t i = 0; i < header.params.size(); ++i)
+	{
+		auto arg = Temp(depth + i);
+		const auto& param = header.params[i];
+		if(IsFloatParam(param) && floatCount < floatArgRegisterCount) registerArgs << "\tmovq " << arg << ", " << FloatRegister(floatCount++) << '\n';
+		else if(!IsFloatParam(param) && intCount < intArgRegisterCount) registerArgs << "\tmovq " << arg << ", " << intArgRegisters[intCount++] << '\n';
+		else stackArgs.push_back(arg);
+	}
+
+	int stackSize = 8 * stackArgs.size();
+	if(stackArgs.size() % 2 == 1)
+	{
+		text << "\tsubq $8, %rsp\n";
+		stackSize += 8;
+	}
+	for(size_t i = stackArgs.size(); i-- > 0;) text << "\tpushq " << stackArgs[i] << '\n';
+	text << registerArgs.str();
+
+	if(funDef && owners.count(funDef)) StaticLink(owners[funDef], "%r10");
+
+	text << "\tcall " << header.name << (funDec ? "@PLT" : "") << '\n';
+	if(stackSize) text << "\taddq $" << stackSize << ", %rsp\n";
+
+	auto result = Temp(depth);
+	if(header.returnType == Type::Float) text << "\tmovq %xmm0, " << result << '\n';
+	else if(header.returnType == Type::Bool && funDec)
+	{
+		// C only defines the low byte of a returned bool
+		text << "\tmovzbq %al, %rax\n" << Move("%rax", result);
+	}
+	else if(header.returnType != Type::Void) text << Move("%rax", result);
+}
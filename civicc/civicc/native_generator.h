@@ -0,0 +1,48 @@
+#pragma once
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "node.h"
+
+
+// Generates x86-64 GNU as assembly from the lowered AST, to be linked with
+// runtime/civic_runtime.c. Every value is 64 bits wide: ints as int64_t, floats
+// as the bits of a double and bools as 0 or 1. Expression temporaries live on a
+// virtual stack whose top entries map to the callee-saved registers, deeper ones
+// spill to the frame, so they survive calls. Calls follow the System V ABI, and
+// a nested function receives the frame pointer of its enclosing function in %r10.
+class NativeGenerator
+{
+public:
+	std::string Generate(Nodes::NodePtr root);
+
+private:
+	std::stringstream text;
+	int labelCounter = 0;
+
+	// Enclosing function of every node inside a function, and of every nested function
+	std::map<Nodes::NodePtr, Nodes::NodePtr> owners;
+	// Frame slot of every local, and of the parameters per function
+	std::map<Nodes::NodePtr, int> slots;
+	std::map<Nodes::NodePtr, std::map<std::string, int>> paramSlots;
+
+	// Per function being generated
+	std::shared_ptr<Nodes::FunctionDef> function;
+	int firstSpillSlot = 0, maxDepth = 0;
+
+	std::string Label();
+	std::string Temp(int depth);
+	std::string Location(Nodes::NodePtr dec, const std::string& name);
+	void StaticLink(Nodes::NodePtr owner, const std::string& reg);
+
+	void FunDef(std::shared_ptr<Nodes::FunctionDef> funDef);
+	void Statement(Nodes::NodePtr node);
+	void ArrayDec(std::shared_ptr<Nodes::AllocateArray> alloc);
+	void Expression(Nodes::NodePtr node, int depth);
+	void FunCall(std::shared_ptr<Nodes::Call> call, int depth);
+	void Arithmetic(std::shared_ptr<Nodes::BinaryOp> binOp, int depth);
+	void Store(int depth, Nodes::NodePtr dec, const std::string& name);
+};
@@ -1,5 +1,6 @@
 #include <sstream>
 #include <map>
+#include <typeinfo>
 
 #include "node.h"
 
@@ -19,8 +20,43 @@ std::string Nodes::TypeToString(Type type)
 
 using namespace Nodes;
 
-uint32_t BaseNode::familyCounter_ = 0;
-std::unordered_map<uint32_t, std::string> BaseNode::familyNames_(1);
+Type Nodes::ExpressionType(NodePtr node)
+{
+	auto literal = StaticCast<Literal>(node);
+	if(literal) return literal->type;
+
+	auto id = StaticCast<Identifier>(node);
+	if(id) return id->type;
+
+	auto call = StaticCast<Call>(node);
+	if(call)
+	{
+		auto funDef = StaticCast<FunctionDef>(call->dec);
+		return funDef ? funDef->header.returnType : StaticCast<FunctionDec>(call->dec)->header.returnType;
+	}
+
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(binOp)
+	{
+		switch(binOp->op)
+		{
+		case Operator::Add: case Operator::Subtract: case Operator::Multiply: case Operator::Divide: case Operator::Modulo:
+			return binOp->type;
+		default:
+			return Type::Bool;
+		}
+	}
+
+	auto unOp = StaticCast<UnaryOp>(node);
+	if(unOp) return unOp->type;
+
+	auto cast = StaticCast<Cast>(node);
+	if(cast) return cast->type;
+
+	return ExpressionType(node->children[1]);
+}
+
+std::atomic<uint32_t> BaseNode::familyCounter_(0);
 
 std::string BaseNode::ToString() const
 {
@@ -34,7 +70,7 @@ uint32_t BaseNode::Family() const
 
 std::string BaseNode::FamilyName() const
 {
-	return familyNames_[family_];
+	return typeid(*this).name();
 }
 
 std::string OperatorToString(Operator op)
@@ -3,7 +3,7 @@
 #include <memory>
 #include <string>
 #include <vector>
-#include <unordered_map>
+#include <atomic>
 #include <cinttypes>
 #include <cassert>
 
@@ -49,6 +49,9 @@ namespace Nodes
 	public:
 		int line, pos;
 		std::vector<NodePtr> children;
+		// Times execution reached this profile point (see profile.h) in the profile
+		// given with --profile-use, -1 when unknown
+		long long profileCount = -1;
 
 		virtual std::string ToString() const;
 
@@ -63,8 +66,7 @@ namespace Nodes
 
 	protected:
 		uint32_t family_ = ~0;
-		static uint32_t familyCounter_;
-		static std::unordered_map<uint32_t, std::string> familyNames_;
+		static std::atomic<uint32_t> familyCounter_;
 	};
 
 	template<class T>
@@ -73,7 +75,6 @@ namespace Nodes
 		Node()
 		{
 			family_ = Family();
-			familyNames_[family_] = typeid(T).name();
 		}
 
 		static int32_t Family()
@@ -171,9 +172,15 @@ namespace Nodes
 		Type type;
 	};
 
+	// Allocates the array of dec. After array lowering the children are the
+	// number of elements, optionally followed by the initialiser: an ArrayExpr
+	// with one element per array element, or a single value to fill it with.
 	struct AllocateArray : public Node<AllocateArray>
 	{
 		Type type;
+		NodePtr dec;
+		// Loop counter and evaluated fill value, only for fills that are not unrolled
+		std::shared_ptr<VarDec> counter, value;
 
 		AllocateArray(Type type) : type(type) {}
 	};
@@ -198,6 +205,8 @@ namespace Nodes
 	{
 		std::string name;
 		NodePtr dec;
+		// Self call in tail position, generated as a jump to the function entry
+		bool tail = false;
 
 		std::string ToString() const override;
 	};
@@ -278,5 +287,10 @@ namespace Nodes
 	struct For : public Node<For>
 	{
 		std::shared_ptr<VarDec> lower, upper, step;
+		// Set instead of step when the step is an integer literal.
+		std::shared_ptr<Literal> constantStep;
 	};
+
+	// Type of the value an analysed expression evaluates to
+	Type ExpressionType(NodePtr node);
 }
@@ -0,0 +1,215 @@
+#include <cstdlib>
+
+#include "peephole.h"
+
+
+struct PeepholeRule
+{
+	const char* name;
+	size_t window;
+	// Rewrites listing[i, i + window) and returns true if the rule matched
+	bool(*apply)(Listing& listing, size_t i);
+};
+
+// Matches "iload_2", "iload 7", ... for the given type prefix and mnemonic
+static bool LocalAccess(const AsmLine& line, const std::string& mnemonic, std::string& index)
+{
+	if(line.kind != AsmLine::Instruction) return false;
+
+	if(line.text == mnemonic && line.args.size() == 1)
+	{
+		index = line.args[0];
+		return true;
+	}
+
+	if(line.text.size() == mnemonic.size() + 2 && line.text.compare(0, mnemonic.size(), mnemonic) == 0 &&
+		line.text[mnemonic.size()] == '_' && line.args.empty())
+	{
+		index = line.text.substr(mnemonic.size() + 1);
+		return index >= "0" && index <= "3";
+	}
+
+	return false;
+}
+
+static bool IsPush(const AsmLine& line, char type)
+{
+	if(line.kind != AsmLine::Instruction || line.text.empty() || line.text[0] != type) return false;
+
+	std::string op = line.text.substr(1);
+	return op == "load" || op == "loadn" || op == "loadg" || op == "loadc" ||
+		op.compare(0, 6, "loadc_") == 0 || (op.size() == 6 && op.compare(0, 5, "load_") == 0);
+}
+
+static void ReplaceWith(Listing& listing, size_t i, size_t count, const AsmLine& line)
+{
+	listing.erase(listing.begin() + i + 1, listing.begin() + i + count);
+	listing[i] = line;
+}
+
+static AsmLine MakeInstruction(const std::string& mnemonic, const std::vector<std::string>& args)
+{
+	AsmLine line;
+	line.kind = AsmLine::Instruction;
+	line.text = mnemonic;
+	line.args = args;
+	return line;
+}
+
+// x = x + c and x = x - c on int locals become iinc/idec
+static bool IncrementFusion(Listing& listing, size_t i)
+{
+	const AsmLine& op = listing[i + 2];
+	std::string local, stored;
+	size_t constant;
+
+	bool add = op.IsInstruction("iadd"), sub = op.IsInstruction("isub");
+	if(!add && !sub) return false;
+	if(!LocalAccess(listing[i + 3], "istore", stored)) return false;
+
+	if(LocalAccess(listing[i], "iload", local)) constant = i + 1;
+	else if(add && LocalAccess(listing[i + 1], "iload", local)) constant = i;
+	else return false;
+
+	if(local != stored) return false;
+
+	const AsmLine& c = listing[constant];
+	if(c.IsInstruction("iloadc_0"))
+	{
+		listing.erase(listing.begin() + i, listing.begin() + i + 4);
+	}
+	else if(c.IsInstruction("iloadc_1") || c.IsInstruction("iloadc_m1"))
+	{
+		bool increment = add == c.IsInstruction("iloadc_1");
+		ReplaceWith(listing, i, 4, MakeInstruction(increment ? "iinc_1" : "idec_1", { local }));
+	}
+	else if(c.IsInstruction("iloadc") && c.args.size() == 1)
+	{
+		// The second operand of iinc/idec is an index into the constant pool
+		ReplaceWith(listing, i, 4, MakeInstruction(add ? "iinc" : "idec", { local, c.args[0] }));
+	}
+	else return false;
+
+	return true;
+}
+
+// A branch on a constant either always or never jumps
+static bool ConstantBranch(Listing& listing, size_t i)
+{
+	const AsmLine& load = listing[i];
+	const AsmLine& branch = listing[i + 1];
+
+	bool value;
+	if(load.IsInstruction("bloadc_t")) value = true;
+	else if(load.IsInstruction("bloadc_f")) value = false;
+	else return false;
+
+	bool condition;
+	if(branch.IsInstruction("branch_t")) condition = true;
+	else if(branch.IsInstruction("branch_f")) condition = false;
+	else return false;
+
+	if(value == condition) ReplaceWith(listing, i, 2, MakeInstruction("jump", branch.args));
+	else listing.erase(listing.begin() + i, listing.begin() + i + 2);
+
+	return true;
+}
+
+// Branching on a negated bool is branching on the opposite condition
+static bool NegatedBranch(Listing& listing, size_t i)
+{
+	const AsmLine& branch = listing[i + 1];
+	if(!listing[i].IsInstruction("bnot")) return false;
+
+	std::string inverse;
+	if(branch.IsInstruction("branch_t")) inverse = "branch_f";
+	else if(branch.IsInstruction("branch_f")) inverse = "branch_t";
+	else return false;
+
+	ReplaceWith(listing, i, 2, MakeInstruction(inverse, branch.args));
+	return true;
+}
+
+// A jump to one of the labels directly following it
+static bool JumpToNext(Listing& listing, size_t i)
+{
+	const AsmLine& jump = listing[i];
+	if(!jump.IsInstruction("jump") || jump.args.size() != 1) return false;
+
+	for(size_t j = i + 1; j < listing.size() && listing[j].kind == AsmLine::Label; ++j)
+	{
+		if(listing[j].text == jump.args[0])
+		{
+			listing.erase(listing.begin() + i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Storing a value into the variable it was just loaded from
+static bool RedundantLoadStore(Listing& listing, size_t i)
+{
+	const AsmLine& load = listing[i];
+	const AsmLine& store = listing[i + 1];
+	if(load.kind != AsmLine::Instruction || load.text.empty()) return false;
+
+	std::string type(1, load.text[0]), loaded, stored;
+	bool local = LocalAccess(load, type + "load", loaded) && LocalAccess(store, type + "store", stored);
+	bool global = LocalAccess(load, type + "loadg", loaded) && LocalAccess(store, type + "storeg", stored);
+	if(!(local || global) || loaded != stored) return false;
+
+	listing.erase(listing.begin() + i, listing.begin() + i + 2);
+	return true;
+}
+
+// A value without side effects that is pushed only to be popped again
+static bool PushPop(Listing& listing, size_t i)
+{
+	const AsmLine& pop = listing[i + 1];
+	if(pop.kind != AsmLine::Instruction || pop.text.size() != 4 || pop.text.compare(1, 3, "pop") != 0) return false;
+	if(!IsPush(listing[i], pop.text[0])) return false;
+
+	listing.erase(listing.begin() + i, listing.begin() + i + 2);
+	return true;
+}
+
+static const PeepholeRule rules[] =
+{
+	{ "increment_fusion", 4, &IncrementFusion },
+	{ "constant_branch", 2, &ConstantBranch },
+	{ "negated_branch", 2, &NegatedBranch },
+	{ "jump_to_next", 2, &JumpToNext },
+	{ "redundant_load_store", 2, &RedundantLoadStore },
+	{ "push_pop", 2, &PushPop },
+};
+
+void Peephole(Listing& listing, Statistics& statistics)
+{
+	const size_t maxWindow = 4;
+	bool changed = true;
+
+	while(changed)
+	{
+		changed = false;
+
+		size_t i = 0;
+		while(i < listing.size())
+		{
+			bool applied = false;
+			for(const auto& rule : rules)
+			{
+				if(i + rule.window > listing.size() || !rule.apply(listing, i)) continue;
+
+				statistics[std::string("peephole.") + rule.name]++;
+				applied = changed = true;
+				break;
+			}
+
+			// Step back so that rewrites can enable matches that start earlier
+			if(applied) i = i >= maxWindow - 1 ? i - (maxWindow - 1) : 0;
+			else i++;
+		}
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "listing.h"
+#include "statistics.h"
+
+
+// Table driven peephole optimiser. Slides a window over the instruction
+// stream and applies the first matching rule, until no rule matches anymore.
+// Every rule that fires is counted under "peephole.<rule>".
+void Peephole(Listing& listing, Statistics& statistics);
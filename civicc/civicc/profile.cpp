@@ -0,0 +1,130 @@
+#include <sstream>
+#include <string>
+
+#include "profile.h"
+
+using namespace Nodes;
+
+
+const char* const ProfileCounterName = "__profile_count";
+
+static const char* const ProfileHeader = "civicc-profile 1";
+
+static void CollectProfilePoints(NodePtr node, std::vector<NodePtr>& points)
+{
+	if(node->IsFamily<FunctionDef>() || node->IsFamily<If>() || node->IsFamily<Else>() ||
+		node->IsFamily<While>() || node->IsFamily<DoWhile>() || node->IsFamily<For>())
+	{
+		points.push_back(node);
+	}
+
+	for(auto child : node->children) CollectProfilePoints(child, points);
+}
+
+static std::vector<NodePtr> ProfilePoints(NodePtr root)
+{
+	std::vector<NodePtr> points;
+	CollectProfilePoints(root, points);
+	return points;
+}
+
+void InstrumentProgram(NodePtr root, Statistics& statistics)
+{
+	auto counter = std::make_shared<FunctionDec>();
+	counter->header.name = ProfileCounterName;
+	counter->header.returnType = Type::Void;
+
+	Param param;
+	param.type = Type::Int;
+	param.name = "id";
+	param.pos = param.line = 0;
+	counter->header.params.push_back(param);
+
+	auto points = ProfilePoints(root);
+	for(size_t id = 0; id < points.size(); ++id)
+	{
+		auto point = points[id];
+		auto call = std::make_shared<Call>();
+		call->name = counter->header.name;
+		call->dec = counter;
+		call->children.push_back(std::make_shared<Literal>((int)id));
+
+		// After the condition of an if or while loop, at the start of anything else
+		auto& children = point->children;
+		size_t position = point->IsFamily<If>() || point->IsFamily<While>() ? 1 : 0;
+		if(point->IsFamily<FunctionDef>())
+		{
+			while(position < children.size() && (children[position]->IsFamily<VarDec>() || children[position]->IsFamily<FunctionDef>())) ++position;
+		}
+		children.insert(children.begin() + position, call);
+	}
+
+	if(!points.empty()) root->children.insert(root->children.begin(), counter);
+	statistics["profile.points"] += points.size();
+}
+
+void ApplyProfile(NodePtr root, const Profile& profile, std::ostream& diagnostics)
+{
+	auto points = ProfilePoints(root);
+	if(!profile.empty() && (profile.begin()->first < 0 || profile.rbegin()->first >= (int)points.size()))
+	{
+		diagnostics << "Warning: the profile does not match the program and is ignored" << std::endl;
+		return;
+	}
+
+	for(size_t id = 0; id < points.size(); ++id)
+	{
+		auto it = profile.find(id);
+		points[id]->profileCount = it == profile.end() ? 0 : it->second;
+	}
+}
+
+void LayoutBranches(NodePtr root, Statistics& statistics)
+{
+	for(auto point : ProfilePoints(root))
+	{
+		auto ifStatement = StaticCast<If>(point);
+		if(!ifStatement) continue;
+
+		auto elseStatement = StaticCast<Else>(ifStatement->children.back());
+		if(!elseStatement || ifStatement->profileCount <= elseStatement->profileCount) continue;
+
+		auto condition = std::make_shared<UnaryOp>(Operator::Not);
+		condition->type = Type::Bool;
+		condition->children.push_back(ifStatement->children[0]);
+
+		std::vector<NodePtr> thenBranch(ifStatement->children.begin() + 1, ifStatement->children.end() - 1);
+		ifStatement->children.assign(1, condition);
+		ifStatement->children.insert(ifStatement->children.end(), elseStatement->children.begin(), elseStatement->children.end());
+		ifStatement->children.push_back(elseStatement);
+		elseStatement->children.swap(thenBranch);
+		std::swap(ifStatement->profileCount, elseStatement->profileCount);
+
+		statistics["profile.branches_swapped"]++;
+	}
+}
+
+bool ReadProfile(std::istream& stream, Profile& profile)
+{
+	std::string line;
+	if(!std::getline(stream, line) || line != ProfileHeader) return false;
+
+	while(std::getline(stream, line))
+	{
+		if(line.empty()) continue;
+
+		std::istringstream istream(line);
+		int id;
+		long long count;
+		if(!(istream >> id >> count)) return false;
+		profile[id] += count;
+	}
+
+	return true;
+}
+
+void WriteProfile(std::ostream& stream, const Profile& profile)
+{
+	stream << ProfileHeader << '\n';
+	for(const auto& point : profile) stream << point.first << ' ' << point.second << '\n';
+}
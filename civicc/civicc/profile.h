@@ -0,0 +1,40 @@
+#pragma once
+
+#include <istream>
+#include <map>
+#include <ostream>
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Execution counts by profile point, as written by a program built with --instrument
+typedef std::map<int, long long> Profile;
+
+// Name of the extern function instrumented programs call with the id of a profile point
+extern const char* const ProfileCounterName;
+
+// Profile points are the entry of every function, the start of the then and
+// else branch of every if and the body of every loop, numbered in the order of
+// a depth-first traversal. They are numbered while the loops still have their
+// source form and before any pass that depends on the optimisation level, so
+// builds of the same source number them the same way at every level.
+
+// Inserts a call to the counter at every profile point. Instrumented points are
+// counted under "profile.points".
+void InstrumentProgram(Nodes::NodePtr root, Statistics& statistics);
+
+// Sets the profileCount of the nodes at the profile points. A profile that
+// names points the program does not have is reported as a warning and ignored.
+void ApplyProfile(Nodes::NodePtr root, const Profile& profile, std::ostream& diagnostics);
+
+// Negates the condition of every if-else whose then branch ran more often than
+// its else branch and swaps the branches. The then branch ends in a jump over
+// the else branch, which the else branch is reached without, so the hot branch
+// is the one that executes fewer instructions.
+// Swapped branches are counted under "profile.branches_swapped".
+void LayoutBranches(Nodes::NodePtr root, Statistics& statistics);
+
+// Text form of a profile: a header line followed by one "<point> <count>" line per point
+bool ReadProfile(std::istream& stream, Profile& profile);
+void WriteProfile(std::ostream& stream, const Profile& profile);
@@ -0,0 +1,421 @@
+#include <cmath>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "pure_calls.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+struct PureValue
+{
+	Type type;
+	// Ints and bools
+	long long i = 0;
+	double f = 0;
+};
+
+// Thrown when a call can not be evaluated at compile time
+struct EvaluationFailed {};
+
+struct PureFrame
+{
+	std::shared_ptr<FunctionDef> function;
+	std::map<std::string, PureValue> params;
+	std::map<NodePtr, PureValue> locals;
+};
+
+struct PureContext
+{
+	std::set<NodePtr> pure;
+	EvaluationBudget budget;
+	int steps = 0, depth = 0;
+	// Results by callee and literal arguments, nullptr when the call could not be evaluated
+	std::map<std::pair<NodePtr, std::string>, std::shared_ptr<Literal>> results;
+	int evaluated = 0;
+};
+
+static PureValue EvaluateExpression(NodePtr node, PureFrame& frame, PureContext& context);
+
+static std::set<NodePtr> PureFunctions(NodePtr root)
+{
+	std::vector<std::shared_ptr<FunctionDef>> funDefs;
+	std::map<NodePtr, std::set<NodePtr>> callees;
+	std::set<NodePtr> pure;
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		funDefs.push_back(funDef);
+
+		bool candidate = funDef->header.returnType != Type::Void;
+		for(const auto& param : funDef->header.params) if(!param.dim.empty()) candidate = false;
+
+		std::set<NodePtr> locals;
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			auto varDec = StaticCast<VarDec>(node);
+			if(varDec) locals.insert(varDec);
+			if(varDec && varDec->var.array) candidate = false;
+			if(node->IsFamily<AllocateArray>() || node->IsFamily<ArrayExpr>()) candidate = false;
+		});
+
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			auto call = StaticCast<Call>(node);
+			if(call && call->dec->IsFamily<FunctionDef>()) callees[funDef].insert(call->dec);
+			else if(call) candidate = false;
+
+			// Only the function's own parameters and locals can be known at compile time
+			NodePtr dec = nullptr;
+			auto id = StaticCast<Identifier>(node);
+			if(id) dec = id->dec;
+			auto assign = StaticCast<Assignment>(node);
+			if(assign) dec = assign->dec;
+			if(dec && dec != funDef && !locals.count(dec)) candidate = false;
+		});
+
+		if(candidate) pure.insert(funDef);
+	});
+
+	// Functions calling impure functions are impure themselves
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(auto funDef : funDefs)
+		{
+			if(!pure.count(funDef)) continue;
+			for(auto callee : callees[funDef])
+			{
+				if(pure.count(callee)) continue;
+				pure.erase(funDef);
+				changed = true;
+				break;
+			}
+		}
+	}
+
+	return pure;
+}
+
+static void Step(PureContext& context)
+{
+	if(++context.steps > context.budget.steps) throw EvaluationFailed();
+}
+
+static PureValue LiteralValue(std::shared_ptr<Literal> literal)
+{
+	PureValue value;
+	value.type = literal->type;
+	if(literal->type == Type::Bool) value.i = literal->boolValue;
+	else if(literal->type == Type::Int) value.i = literal->intValue;
+	// Float constants are read in single precision and computed with in double
+	else value.f = literal->floatValue;
+	return value;
+}
+
+static std::shared_ptr<Literal> ValueLiteral(const PureValue& value)
+{
+	if(value.type == Type::Bool) return std::make_shared<Literal>(value.i != 0);
+	if(value.type == Type::Int)
+	{
+		if(value.i < std::numeric_limits<int>::min() || value.i > std::numeric_limits<int>::max()) return nullptr;
+		return std::make_shared<Literal>((int)value.i);
+	}
+
+	// Only exact values, since the constant is read back in single precision
+	if(!std::isfinite(value.f) || (double)(float)value.f != value.f) return nullptr;
+	return std::make_shared<Literal>((float)value.f);
+}
+
+static PureValue IntValue(Type type, long long i)
+{
+	PureValue value;
+	value.type = type;
+	value.i = i;
+	return value;
+}
+
+static PureValue FloatValue(double f)
+{
+	PureValue value;
+	value.type = Type::Float;
+	value.f = f;
+	return value;
+}
+
+static PureValue EvaluateBinaryOp(std::shared_ptr<BinaryOp> binOp, PureFrame& frame, PureContext& context)
+{
+	if(binOp->op == Operator::And || binOp->op == Operator::Or)
+	{
+		auto left = EvaluateExpression(binOp->children[0], frame, context);
+		if((left.i != 0) == (binOp->op == Operator::Or)) return left;
+		return EvaluateExpression(binOp->children[1], frame, context);
+	}
+
+	auto left = EvaluateExpression(binOp->children[0], frame, context);
+	auto right = EvaluateExpression(binOp->children[1], frame, context);
+
+	if(left.type == Type::Float)
+	{
+		double a = left.f, b = right.f;
+		switch(binOp->op)
+		{
+		case Operator::Add: return FloatValue(a + b);
+		case Operator::Subtract: return FloatValue(a - b);
+		case Operator::Multiply: return FloatValue(a * b);
+		case Operator::Divide: return FloatValue(a / b);
+		case Operator::Equal: return IntValue(Type::Bool, a == b);
+		case Operator::NotEqual: return IntValue(Type::Bool, a != b);
+		case Operator::Less: return IntValue(Type::Bool, a < b);
+		case Operator::LessEqual: return IntValue(Type::Bool, a <= b);
+		case Operator::More: return IntValue(Type::Bool, a > b);
+		case Operator::MoreEqual: return IntValue(Type::Bool, a >= b);
+		default: throw EvaluationFailed();
+		}
+	}
+
+	// Wrap around at 64 bits like the VM, without signed overflow
+	long long a = left.i, b = right.i;
+	unsigned long long x = a, y = b;
+	switch(binOp->op)
+	{
+	case Operator::Add: return IntValue(left.type, (long long)(x + y));
+	case Operator::Subtract: return IntValue(left.type, (long long)(x - y));
+	case Operator::Multiply: return IntValue(left.type, (long long)(x * y));
+	case Operator::Divide:
+	case Operator::Modulo:
+		// Division by zero is left to fail at run time
+		if(b == 0 || (a == std::numeric_limits<long long>::min() && b == -1)) throw EvaluationFailed();
+		return IntValue(left.type, binOp->op == Operator::Divide ? a / b : a % b);
+	case Operator::Equal: return IntValue(Type::Bool, a == b);
+	case Operator::NotEqual: return IntValue(Type::Bool, a != b);
+	case Operator::Less: return IntValue(Type::Bool, a < b);
+	case Operator::LessEqual: return IntValue(Type::Bool, a <= b);
+	case Operator::More: return IntValue(Type::Bool, a > b);
+	case Operator::MoreEqual: return IntValue(Type::Bool, a >= b);
+	default: throw EvaluationFailed();
+	}
+}
+
+static PureValue EvaluateCast(std::shared_ptr<Cast> cast, PureFrame& frame, PureContext& context)
+{
+	auto value = EvaluateExpression(cast->children[0], frame, context);
+	if(value.type == cast->type) return value;
+
+	double number = value.type == Type::Float ? value.f : (double)value.i;
+	if(cast->type == Type::Float) return FloatValue(number);
+	if(cast->type == Type::Bool) return IntValue(Type::Bool, number != 0);
+
+	// Out of range conversions are undefined
+	if(!(number >= -9223372036854775808.0 && number < 9223372036854775808.0)) throw EvaluationFailed();
+	return IntValue(Type::Int, value.type == Type::Float ? (long long)value.f : value.i);
+}
+
+static bool EvaluateStatements(NodePtr block, size_t begin, size_t end, PureFrame& frame, PureContext& context, PureValue& result);
+
+static PureValue EvaluateCall(std::shared_ptr<FunctionDef> funDef, const std::vector<PureValue>& args, PureContext& context)
+{
+	if(++context.depth > context.budget.depth) throw EvaluationFailed();
+
+	PureFrame frame;
+	frame.function = funDef;
+	for(size_t i = 0; i < args.size(); ++i) frame.params[funDef->header.params[i].name] = args[i];
+
+	TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+	{
+		auto varDec = StaticCast<VarDec>(node);
+		if(varDec) frame.locals[varDec] = IntValue(varDec->var.type, 0);
+	});
+
+	PureValue result;
+	if(!EvaluateStatements(funDef, 0, funDef->children.size(), frame, context, result)) throw EvaluationFailed();
+
+	context.depth--;
+	return result;
+}
+
+static PureValue EvaluateExpression(NodePtr node, PureFrame& frame, PureContext& context)
+{
+	Step(context);
+
+	auto literal = StaticCast<Literal>(node);
+	if(literal) return LiteralValue(literal);
+
+	auto id = StaticCast<Identifier>(node);
+	if(id) return id->dec == frame.function ? frame.params.at(id->name) : frame.locals.at(id->dec);
+
+	auto call = StaticCast<Call>(node);
+	if(call)
+	{
+		std::vector<PureValue> args;
+		for(auto child : call->children) args.push_back(EvaluateExpression(child, frame, context));
+		return EvaluateCall(std::static_pointer_cast<FunctionDef>(call->dec), args, context);
+	}
+
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(binOp) return EvaluateBinaryOp(binOp, frame, context);
+
+	auto unOp = StaticCast<UnaryOp>(node);
+	if(unOp)
+	{
+		auto value = EvaluateExpression(unOp->children[0], frame, context);
+		if(unOp->op == Operator::Not) value.i = !value.i;
+		else if(value.type == Type::Float) value.f = -value.f;
+		else value.i = (long long)(0ULL - (unsigned long long)value.i);
+		return value;
+	}
+
+	auto cast = StaticCast<Cast>(node);
+	if(cast) return EvaluateCast(cast, frame, context);
+
+	auto ternary = StaticCast<Ternary>(node);
+	if(ternary)
+	{
+		auto condition = EvaluateExpression(ternary->children[0], frame, context);
+		return EvaluateExpression(ternary->children[condition.i ? 1 : 2], frame, context);
+	}
+
+	throw EvaluationFailed();
+}
+
+// Returns whether a return statement was executed, whose value is put in result
+static bool EvaluateStatements(NodePtr block, size_t begin, size_t end, PureFrame& frame, PureContext& context, PureValue& result)
+{
+	for(size_t i = begin; i < end; ++i)
+	{
+		auto node = block->children[i];
+		if(node->IsFamily<VarDec>() || node->IsFamily<FunctionDef>()) continue;
+		Step(context);
+
+		auto assign = StaticCast<Assignment>(node);
+		if(assign)
+		{
+			auto value = EvaluateExpression(assign->children[0], frame, context);
+			if(assign->dec == frame.function) frame.params[assign->name] = value;
+			else frame.locals[assign->dec] = value;
+			continue;
+		}
+
+		if(node->IsFamily<Call>())
+		{
+			EvaluateExpression(node, frame, context);
+			continue;
+		}
+
+		auto ret = StaticCast<Return>(node);
+		if(ret)
+		{
+			if(ret->children.empty()) throw EvaluationFailed();
+			result = EvaluateExpression(ret->children[0], frame, context);
+			return true;
+		}
+
+		auto ifStatement = StaticCast<If>(node);
+		if(ifStatement)
+		{
+			auto elseStatement = StaticCast<Else>(ifStatement->children.back());
+			size_t thenEnd = ifStatement->children.size() - (elseStatement ? 1 : 0);
+
+			bool returned;
+			if(EvaluateExpression(ifStatement->children[0], frame, context).i) returned = EvaluateStatements(ifStatement, 1, thenEnd, frame, context, result);
+			else returned = elseStatement && EvaluateStatements(elseStatement, 0, elseStatement->children.size(), frame, context, result);
+
+			if(returned) return true;
+			continue;
+		}
+
+		auto doWhile = StaticCast<DoWhile>(node);
+		if(doWhile)
+		{
+			size_t bodyEnd = doWhile->children.size() - 1;
+			do
+			{
+				if(EvaluateStatements(doWhile, 0, bodyEnd, frame, context, result)) return true;
+			}
+			while(EvaluateExpression(doWhile->children.back(), frame, context).i);
+			continue;
+		}
+
+		throw EvaluationFailed();
+	}
+
+	return false;
+}
+
+static std::shared_ptr<Literal> EvaluateLiteralCall(std::shared_ptr<Call> call, PureContext& context)
+{
+	if(!context.pure.count(call->dec)) return nullptr;
+
+	std::vector<PureValue> args;
+	std::stringstream key;
+	key.precision(17);
+	for(auto child : call->children)
+	{
+		auto literal = StaticCast<Literal>(child);
+		if(!literal) return nullptr;
+
+		args.push_back(LiteralValue(literal));
+		key << args.back().i << ' ' << args.back().f << ' ';
+	}
+
+	auto cached = context.results.find({ call->dec, key.str() });
+	if(cached != context.results.end()) return cached->second;
+
+	std::shared_ptr<Literal> literal = nullptr;
+	context.steps = context.depth = 0;
+	try
+	{
+		literal = ValueLiteral(EvaluateCall(std::static_pointer_cast<FunctionDef>(call->dec), args, context));
+	}
+	catch(EvaluationFailed) {}
+
+	context.results[{ call->dec, key.str() }] = literal;
+	return literal;
+}
+
+// Whether the child at index is a statement, whose value is not used
+static bool IsStatementChild(NodePtr parent, size_t index)
+{
+	if(parent->IsFamily<FunctionDef>() || parent->IsFamily<Else>()) return true;
+	if(parent->IsFamily<If>()) return index > 0;
+	if(parent->IsFamily<DoWhile>()) return index + 1 < parent->children.size();
+	return false;
+}
+
+static void ReplaceCalls(NodePtr node, PureContext& context)
+{
+	for(size_t i = 0; i < node->children.size(); ++i)
+	{
+		auto& child = node->children[i];
+		ReplaceCalls(child, context);
+
+		auto call = StaticCast<Call>(child);
+		if(!call || IsStatementChild(node, i)) continue;
+
+		auto literal = EvaluateLiteralCall(call, context);
+		if(!literal) continue;
+
+		auto replacement = std::make_shared<Literal>(*literal);
+		replacement->pos = call->pos;
+		replacement->line = call->line;
+		child = replacement;
+		context.evaluated++;
+	}
+}
+
+bool EvaluatePureCalls(NodePtr root, const EvaluationBudget& budget, Statistics& statistics)
+{
+	PureContext context;
+	context.pure = PureFunctions(root);
+	context.budget = budget;
+	if(context.pure.empty()) return false;
+
+	ReplaceCalls(root, context);
+
+	statistics["pure_calls.evaluated"] += context.evaluated;
+	return context.evaluated > 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Bounds on the work EvaluatePureCalls does for a single call
+struct EvaluationBudget
+{
+	// Statements and expressions evaluated
+	int steps = 10000;
+	// Calls active at the same time
+	int depth = 64;
+};
+
+// Replaces calls to pure functions whose arguments are all literals by the
+// value they return, computed by interpreting the callee at compile time with
+// the 64 bit ints and double floats of the VM. A function is pure when it only
+// touches its own parameters and locals, has no arrays and only calls pure
+// functions. Calls whose evaluation exceeds the budget, fails, like a division
+// by zero, or returns a value a literal can not hold are left alone. Replaced
+// calls are counted under "pure_calls.evaluated". Returns whether any call was
+// replaced.
+bool EvaluatePureCalls(Nodes::NodePtr root, const EvaluationBudget& budget, Statistics& statistics);
@@ -4,22 +4,65 @@
 using namespace Nodes;
 
 
+NodePtr StepCondition(std::shared_ptr<For> forLoop, NodePtr lowerId, NodePtr upperId)
+{
+	// A literal step fixes the direction of the loop, so a single comparison suffices.
+	if(forLoop->constantStep)
+	{
+		auto compare = std::make_shared<BinaryOp>(forLoop->constantStep->intValue > 0 ? Operator::Less : Operator::More);
+		compare->type = Type::Int;
+		compare->children.push_back(lowerId);
+		compare->children.push_back(upperId);
+		return compare;
+	}
+
+	auto condition = std::make_shared<Ternary>();
+	auto stepId = std::make_shared<Identifier>(forLoop->step->var.name);
+	auto stepOp = std::make_shared<BinaryOp>(Operator::More);
+	auto lessOp = std::make_shared<BinaryOp>(Operator::Less);
+	auto moreOp = std::make_shared<BinaryOp>(Operator::More);
+
+	stepId->type = Type::Int;
+	stepId->dec = forLoop->step;
+
+	stepOp->type = lessOp->type = moreOp->type = Type::Int;
+	stepOp->children.push_back(stepId);
+	stepOp->children.push_back(std::make_shared<Literal>(0));
+
+	lessOp->children.push_back(lowerId);
+	lessOp->children.push_back(upperId);
+
+	moreOp->children.push_back(lowerId);
+	moreOp->children.push_back(upperId);
+
+	condition->children.push_back(stepOp);
+	condition->children.push_back(lessOp);
+	condition->children.push_back(moreOp);
+
+	return condition;
+}
+
+NodePtr StepValue(std::shared_ptr<For> forLoop)
+{
+	if(forLoop->constantStep) return std::make_shared<Literal>(forLoop->constantStep->intValue);
+
+	auto stepId = std::make_shared<Identifier>(forLoop->step->var.name);
+	stepId->type = Type::Int;
+	stepId->dec = forLoop->step;
+	return stepId;
+}
+
 void ReplaceForLoops(NodePtr root)
 {
 	Replace<For>(root, [](std::shared_ptr<For> forLoop)
 	{
 		auto whileLoop = std::make_shared<While>();
-		auto condition = std::make_shared<Ternary>();
-		auto stepId = std::make_shared<Identifier>(forLoop->step->var.name);
 		auto lowerId = std::make_shared<Identifier>(forLoop->lower->var.name);
 		auto upperId = std::make_shared<Identifier>(forLoop->upper->var.name);
-		auto stepOp = std::make_shared<BinaryOp>(Operator::More);
-		auto lessOp = std::make_shared<BinaryOp>(Operator::Less);
-		auto moreOp = std::make_shared<BinaryOp>(Operator::More);
 		auto assign = std::make_shared<Assignment>(forLoop->lower->var.name);
 		auto increment = std::make_shared<BinaryOp>(Operator::Add);
 
-		whileLoop->children.push_back(condition);
+		whileLoop->children.push_back(StepCondition(forLoop, lowerId, upperId));
 		whileLoop->children.insert(whileLoop->children.end(), forLoop->children.begin(), forLoop->children.end());
 		whileLoop->children.push_back(assign);
 
@@ -27,27 +70,12 @@ void ReplaceForLoops(NodePtr root)
 		assign->dec = forLoop->lower;
 		assign->children.push_back(increment);
 		increment->children.push_back(lowerId);
-		increment->children.push_back(stepId);
+		increment->children.push_back(StepValue(forLoop));
 
-		stepId->type = lowerId->type = upperId->type = Type::Int;
-		stepId->dec = forLoop->step;
+		lowerId->type = upperId->type = Type::Int;
 		lowerId->dec = forLoop->lower;
 		upperId->dec = forLoop->upper;
 
-		stepOp->type = lessOp->type = moreOp->type = Type::Int;
-		stepOp->children.push_back(stepId);
-		stepOp->children.push_back(std::make_shared<Literal>(0));
-
-		lessOp->children.push_back(lowerId);
-		lessOp->children.push_back(upperId);
-
-		moreOp->children.push_back(lowerId);
-		moreOp->children.push_back(upperId);
-
-		condition->children.push_back(stepOp);
-		condition->children.push_back(lessOp);
-		condition->children.push_back(moreOp);
-
 		return whileLoop;
 	});
 }
@@ -2,6 +2,7 @@
 #include <vector>
 #include <map>
 #include <sstream>
+#include <limits>
 
 #include "seperation.h"
 #include "traverse.h"
@@ -13,9 +14,17 @@ void SeperateVarDecFromInit(NodePtr root)
 {
 	TraverseBreadth<VarDec>(root, [](std::shared_ptr<VarDec> varDec, NodePtr parent)
 	{
-		if(!varDec->HasAssignment()) return;
-
 		auto& list = parent->children;
+		if(!varDec->HasAssignment())
+		{
+			if(!varDec->var.array) return;
+
+			auto alloc = std::make_shared<AllocateArray>(varDec->var.type);
+			alloc->dec = varDec;
+			list.insert(++std::find(list.begin(), list.end(), varDec), alloc);
+			return;
+		}
+
 		auto it = std::find(list.begin(), list.end(), varDec);
 		if(it != list.end())
 		{
@@ -29,7 +38,9 @@ void SeperateVarDecFromInit(NodePtr root)
 			if(varDec->var.array)
 			{
 				it = std::find(list.begin(), list.end(), assignment);
-				list.insert(it, std::make_shared<AllocateArray>(varDec->var.type));
+				auto alloc = std::make_shared<AllocateArray>(varDec->var.type);
+				alloc->dec = varDec;
+				list.insert(it, alloc);
 			}
 		}
 	});
@@ -44,9 +55,14 @@ void SeperateGlobalDefFromInit(NodePtr root)
 
 	TraverseBreadth<GlobalDef>(root, [&](std::shared_ptr<GlobalDef> globalDef, NodePtr parent)
 	{
-		if(!globalDef->HasAssignment()) return;
+		if(globalDef->var.array)
+		{
+			auto alloc = std::make_shared<AllocateArray>(globalDef->var.type);
+			alloc->dec = globalDef;
+			init->children.push_back(alloc);
+		}
 
-		if(globalDef->var.array) init->children.push_back(std::make_shared<AllocateArray>(globalDef->var.type));
+		if(!globalDef->HasAssignment()) return;
 
 		auto assignment = std::make_shared<Assignment>(globalDef->var.name);
 		assignment->pos = globalDef->pos;
@@ -88,10 +104,28 @@ void ReplaceNamesInFor(NodePtr root)
 	});
 }
 
+std::shared_ptr<Literal> ConstantStep(NodePtr step)
+{
+	auto literal = StaticCast<Literal>(step);
+	if(literal) return literal->type == Type::Int ? literal : nullptr;
+
+	auto negate = StaticCast<UnaryOp>(step);
+	if(negate && negate->op == Operator::Negate)
+	{
+		literal = StaticCast<Literal>(negate->children[0]);
+		if(literal && literal->type == Type::Int && literal->intValue != std::numeric_limits<int>::min())
+		{
+			return std::make_shared<Literal>(-literal->intValue);
+		}
+	}
+
+	return nullptr;
+}
+
 void SeperateForLoopInduction(NodePtr root)
 {
 	std::stringstream sstream;
-	std::map<NodePtr, std::vector<NodePtr>> map;
+	std::map<NodePtr, std::vector<std::vector<NodePtr>>> map;
 
 	ReplaceNamesInFor(root);
 
@@ -101,43 +135,50 @@ void SeperateForLoopInduction(NodePtr root)
 		auto lowerAss = std::static_pointer_cast<Assignment>(forLoop->children[1]);
 		auto upperVar = std::make_shared<VarDec>();
 		auto upperAss = std::make_shared<Assignment>("");
-		auto stepVar = std::make_shared<VarDec>();
-		auto stepAss = std::make_shared<Assignment>("");
 
-		lowerVar->var.type = upperVar->var.type = stepVar->var.type = Type::Int;
-		lowerVar->immutable = upperVar->immutable = stepVar->immutable = true;
+		lowerVar->var.type = upperVar->var.type = Type::Int;
+		lowerVar->immutable = upperVar->immutable = true;
 
 		upperVar->var.name = "_U" + lowerVar->var.name;
 		upperAss->children.push_back(forLoop->children[2]);
 		upperAss->name = upperVar->var.name;
-		stepVar->var.name = "_S" + lowerVar->var.name;
-		stepAss->children.push_back(forLoop->children[3]);
-		stepAss->name = stepVar->var.name;
-
-		map[parent].push_back(forLoop);
-		map[parent].push_back(lowerVar);
-		map[parent].push_back(lowerAss);
-		map[parent].push_back(upperVar);
-		map[parent].push_back(upperAss);
-		map[parent].push_back(stepVar);
-		map[parent].push_back(stepAss);
 
 		forLoop->lower = lowerVar;
 		forLoop->upper = upperVar;
-		forLoop->step = stepVar;
+		forLoop->constantStep = ConstantStep(forLoop->children[3]);
+
+		std::vector<NodePtr> inserts = { forLoop, lowerVar, lowerAss, upperVar, upperAss };
+
+		if(!forLoop->constantStep)
+		{
+			auto stepVar = std::make_shared<VarDec>();
+			auto stepAss = std::make_shared<Assignment>("");
+
+			stepVar->var.type = Type::Int;
+			stepVar->immutable = true;
+			stepVar->var.name = "_S" + lowerVar->var.name;
+			stepAss->children.push_back(forLoop->children[3]);
+			stepAss->name = stepVar->var.name;
+
+			inserts.push_back(stepVar);
+			inserts.push_back(stepAss);
+
+			forLoop->step = stepVar;
+		}
+
+		map[parent].push_back(inserts);
 	});
 
 	for(auto pair : map)
 	{
 		NodePtr parent = pair.first;
-		std::vector<NodePtr>& newInserts = pair.second;
 
-		for(size_t i = 0; i < newInserts.size(); i += 7)
+		for(const auto& inserts : pair.second)
 		{
-			NodePtr forLoop = newInserts[i];
+			NodePtr forLoop = inserts.front();
 			auto it = std::find(parent->children.begin(), parent->children.end(), forLoop);
 
-			parent->children.insert(it, newInserts.begin() + i + 1, newInserts.begin() + i + 7);
+			parent->children.insert(it, inserts.begin() + 1, inserts.end());
 			forLoop->children.erase(forLoop->children.begin(), forLoop->children.begin() + 4);
 		}
 	}
@@ -0,0 +1,346 @@
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <queue>
+#include <vector>
+#include <condition_variable>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <exception>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#endif
+
+#include "server.h"
+
+
+ResultCache::ResultCache(size_t capacity) :
+	capacity(capacity)
+{
+}
+
+std::string ResultCache::Key(const std::string& source, const CompileOptions& options)
+{
+	std::stringstream sstream;
+	sstream << std::hash<std::string>()(source) << ':' << OptionsToString(options);
+	return sstream.str();
+}
+
+bool ResultCache::Find(const std::string& source, const CompileOptions& options, CompileResult& result)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = index.find(Key(source, options));
+	if(it == index.end() || it->second->source != source) return false;
+
+	entries.splice(entries.begin(), entries, it->second);
+	result = it->second->result;
+	return true;
+}
+
+void ResultCache::Insert(const std::string& source, const CompileOptions& options, const CompileResult& result)
+{
+	if(capacity == 0) return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::string key = Key(source, options);
+
+	auto it = index.find(key);
+	if(it != index.end())
+	{
+		entries.erase(it->second);
+		index.erase(it);
+	}
+
+	entries.push_front({ key, source, result });
+	index[key] = entries.begin();
+
+	if(entries.size() > capacity)
+	{
+		index.erase(entries.back().key);
+		entries.pop_back();
+	}
+}
+
+#ifdef _WIN32
+
+std::string DefaultSocketPath()
+{
+	return "";
+}
+
+int RunServer(const std::string&, unsigned, size_t)
+{
+	std::cout << "Server mode is not supported on this platform.\n";
+	return -1;
+}
+
+bool CompileRemote(const std::string&, const std::string&, const CompileOptions&, CompileResult&)
+{
+	return false;
+}
+
+#else
+
+// Every message is a sequence of frames, each a 32 bit length in network byte
+// order followed by that many bytes. A request holds the options and the
+// source, a response the success flag, diagnostics, log, assembly and the
+// optimisation statistics.
+
+static const uint32_t maxFrameSize = 1 << 28;
+
+static bool WriteAll(int fd, const char* data, size_t size)
+{
+	while(size > 0)
+	{
+		ssize_t written = write(fd, data, size);
+		if(written <= 0) return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+static bool ReadAll(int fd, char* data, size_t size)
+{
+	while(size > 0)
+	{
+		ssize_t received = read(fd, data, size);
+		if(received <= 0) return false;
+		data += received;
+		size -= received;
+	}
+	return true;
+}
+
+static bool WriteFrame(int fd, const std::string& frame)
+{
+	uint32_t length = htonl((uint32_t)frame.size());
+	return WriteAll(fd, (const char*)&length, sizeof(length)) && WriteAll(fd, frame.data(), frame.size());
+}
+
+static bool ReadFrame(int fd, std::string& frame)
+{
+	uint32_t length;
+	if(!ReadAll(fd, (char*)&length, sizeof(length))) return false;
+
+	length = ntohl(length);
+	if(length > maxFrameSize) return false;
+
+	frame.resize(length);
+	return frame.empty() || ReadAll(fd, &frame[0], frame.size());
+}
+
+static bool MakeAddress(const std::string& socketPath, sockaddr_un& address)
+{
+	if(socketPath.size() >= sizeof(address.sun_path)) return false;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketPath.c_str());
+	return true;
+}
+
+// Whether the process on the other end of the socket runs as this user, so
+// that no one else can hand us assembly or send us sources
+static bool PeerIsUser(int fd)
+{
+#ifdef SO_PEERCRED
+	ucred credentials;
+	socklen_t size = sizeof(credentials);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 && credentials.uid == getuid();
+#else
+	uid_t uid;
+	gid_t gid;
+	return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+static std::string SocketDirectory(const std::string& socketPath)
+{
+	size_t slash = socketPath.find_last_of('/');
+	if(slash == std::string::npos) return ".";
+	return slash == 0 ? "/" : socketPath.substr(0, slash);
+}
+
+// Whether the directory of the socket belongs to this user and no one else can
+// create or replace files in it
+static bool IsPrivateDirectory(const std::string& directory)
+{
+	struct stat info;
+	return lstat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode) && info.st_uid == getuid() &&
+		(info.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+// Removes the socket of a server that is no longer running, but never the
+// socket of a running server or a file that is not a socket
+static bool RemoveStaleSocket(const std::string& socketPath, const sockaddr_un& address)
+{
+	struct stat info;
+	if(lstat(socketPath.c_str(), &info) != 0) return errno == ENOENT;
+	if(!S_ISSOCK(info.st_mode)) return false;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) return false;
+
+	bool running = connect(fd, (sockaddr*)&address, sizeof(address)) == 0;
+	close(fd);
+	return !running && unlink(socketPath.c_str()) == 0;
+}
+
+std::string DefaultSocketPath()
+{
+	std::stringstream sstream;
+	const char* runtimeDir = getenv("XDG_RUNTIME_DIR");
+	if(runtimeDir && *runtimeDir) sstream << runtimeDir << "/civicc.sock";
+	else sstream << "/tmp/civicc-" << getuid() << "/civicc.sock";
+	return sstream.str();
+}
+
+static void HandleRequest(int fd, ResultCache& cache)
+{
+	std::string optionsStr, source;
+	if(!PeerIsUser(fd) || !ReadFrame(fd, optionsStr) || !ReadFrame(fd, source)) return;
+
+	CompileOptions options = OptionsFromString(optionsStr);
+	CompileResult result;
+	if(!cache.Find(source, options, result))
+	{
+		// A request that crashes the compiler must not take the worker down with it
+		try
+		{
+			result = Compile(source, options);
+			cache.Insert(source, options, result);
+		}
+		catch(const std::exception& e)
+		{
+			result = CompileResult();
+			result.diagnostics = std::string("Internal compiler error: ") + e.what() + "\n";
+		}
+	}
+
+	WriteFrame(fd, result.success ? "1" : "0") && WriteFrame(fd, result.diagnostics) &&
+		WriteFrame(fd, result.log) && WriteFrame(fd, result.assembly) &&
+		WriteFrame(fd, StatisticsToString(result.statistics));
+}
+
+int RunServer(const std::string& socketPath, unsigned workers, size_t cacheSize)
+{
+	sockaddr_un address;
+	if(!MakeAddress(socketPath, address))
+	{
+		std::cout << "Socket path too long: " << socketPath << '\n';
+		return -1;
+	}
+
+	// Only creates the last directory, with permissions for this user alone
+	std::string directory = SocketDirectory(socketPath);
+	mkdir(directory.c_str(), 0700);
+	if(!IsPrivateDirectory(directory))
+	{
+		std::cout << "The socket directory " << directory << " must belong to you and be writable by no one else\n";
+		return -1;
+	}
+
+	if(!RemoveStaleSocket(socketPath, address))
+	{
+		std::cout << "Not replacing " << socketPath << ", it is in use or not a socket\n";
+		return -1;
+	}
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listener < 0)
+	{
+		std::cout << "Could not create socket\n";
+		return -1;
+	}
+
+	if(bind(listener, (sockaddr*)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0)
+	{
+		std::cout << "Could not listen on " << socketPath << '\n';
+		close(listener);
+		return -1;
+	}
+
+	// Clients that hang up early should not take the server down
+	signal(SIGPIPE, SIG_IGN);
+
+	ResultCache cache(cacheSize);
+	std::queue<int> pending;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector<std::thread> pool;
+
+	if(workers == 0) workers = 1;
+	for(unsigned i = 0; i < workers; ++i)
+	{
+		pool.emplace_back([&]()
+		{
+			for(;;)
+			{
+				int fd;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					condition.wait(lock, [&]() { return !pending.empty(); });
+					fd = pending.front();
+					pending.pop();
+				}
+
+				HandleRequest(fd, cache);
+				close(fd);
+			}
+		});
+	}
+
+	std::cout << "Listening on " << socketPath << " with " << workers << " workers" << std::endl;
+
+	for(;;)
+	{
+		int fd = accept(listener, nullptr, nullptr);
+		if(fd < 0) continue;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push(fd);
+		condition.notify_one();
+	}
+}
+
+bool CompileRemote(const std::string& socketPath, const std::string& source, const CompileOptions& options, CompileResult& result)
+{
+	sockaddr_un address;
+	if(!MakeAddress(socketPath, address)) return false;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) return false;
+
+	// Anyone could have put a socket at the path, so only a server run by this user is trusted
+	if(connect(fd, (sockaddr*)&address, sizeof(address)) < 0 || !PeerIsUser(fd))
+	{
+		close(fd);
+		return false;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	std::string success, statistics;
+	bool received = WriteFrame(fd, OptionsToString(options)) && WriteFrame(fd, source) &&
+		ReadFrame(fd, success) && ReadFrame(fd, result.diagnostics) &&
+		ReadFrame(fd, result.log) && ReadFrame(fd, result.assembly) &&
+		ReadFrame(fd, statistics);
+	close(fd);
+
+	result.success = success == "1";
+	result.statistics = StatisticsFromString(statistics);
+	return received;
+}
+
+#endif
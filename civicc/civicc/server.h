@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+#include "compiler.h"
+
+
+// Least recently used cache of compile results, keyed by a hash of the source
+// and the compile options. The source is kept with each entry so that a hash
+// collision can never return the result of a different program.
+class ResultCache
+{
+public:
+	ResultCache(size_t capacity);
+
+	bool Find(const std::string& source, const CompileOptions& options, CompileResult& result);
+	void Insert(const std::string& source, const CompileOptions& options, const CompileResult& result);
+
+private:
+	struct Entry
+	{
+		std::string key, source;
+		CompileResult result;
+	};
+
+	size_t capacity;
+	std::mutex mutex;
+	std::list<Entry> entries;
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+	static std::string Key(const std::string& source, const CompileOptions& options);
+};
+
+// In $XDG_RUNTIME_DIR, or otherwise in a directory in /tmp that only this user
+// can write to
+std::string DefaultSocketPath();
+
+// Listens on a Unix domain socket and compiles the received sources on a pool
+// of worker threads. Only returns on error.
+int RunServer(const std::string& socketPath, unsigned workers, size_t cacheSize);
+
+// Sends a compile request to a running server. Returns false if no server could
+// be reached, in which case the caller should compile locally.
+bool CompileRemote(const std::string& socketPath, const std::string& source, const CompileOptions& options, CompileResult& result);
@@ -0,0 +1,369 @@
+#include <cmath>
+
+#include "simplifier.h"
+#include "constant_folding.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+typedef NodePtr (*Rewrite)(NodePtr node);
+
+struct SimplifyRule
+{
+	const char* pattern;
+	Rewrite rewrite;
+};
+
+bool IsConstant(NodePtr node, int value)
+{
+	auto literal = StaticCast<Literal>(node);
+	if(!literal) return false;
+
+	if(literal->type == Type::Int) return literal->intValue == value;
+	// -0.0 is not an identity element: -0.0 - -0.0 is 0.0
+	if(literal->type == Type::Float) return literal->floatValue == (float)value && !std::signbit(literal->floatValue);
+	return false;
+}
+
+bool IsBoolConstant(NodePtr node, bool value)
+{
+	auto literal = StaticCast<Literal>(node);
+	return literal && literal->type == Type::Bool && literal->boolValue == value;
+}
+
+// Whether evaluating the expression twice, or not at all, is unobservable
+bool IsEffectFree(NodePtr root)
+{
+	bool free = true;
+
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		if(node->IsFamily<Call>() || node->IsFamily<ArrayExpr>()) free = false;
+
+		auto binOp = StaticCast<BinaryOp>(node);
+		if(binOp && (binOp->op == Operator::Divide || binOp->op == Operator::Modulo)) free = false;
+	});
+
+	return free;
+}
+
+bool SameValue(NodePtr a, NodePtr b)
+{
+	if(a == b) return true;
+	if(a->Family() != b->Family() || a->children.size() != b->children.size()) return false;
+
+	auto literalA = StaticCast<Literal>(a), literalB = StaticCast<Literal>(b);
+	if(literalA)
+	{
+		if(literalA->type != literalB->type) return false;
+		if(literalA->type == Type::Int) return literalA->intValue == literalB->intValue;
+		if(literalA->type == Type::Float)
+		{
+			return literalA->floatValue == literalB->floatValue && std::signbit(literalA->floatValue) == std::signbit(literalB->floatValue);
+		}
+		return literalA->boolValue == literalB->boolValue;
+	}
+
+	auto idA = StaticCast<Identifier>(a), idB = StaticCast<Identifier>(b);
+	if(idA) return idA->dec == idB->dec && idA->name == idB->name;
+
+	auto binA = StaticCast<BinaryOp>(a), binB = StaticCast<BinaryOp>(b);
+	if(binA && (binA->op != binB->op || binA->type != binB->type)) return false;
+
+	auto unA = StaticCast<UnaryOp>(a), unB = StaticCast<UnaryOp>(b);
+	if(unA && (unA->op != unB->op || unA->type != unB->type)) return false;
+
+	auto castA = StaticCast<Cast>(a), castB = StaticCast<Cast>(b);
+	if(castA && (castA->type != castB->type || castA->castFrom != castB->castFrom)) return false;
+
+	if(!binA && !unA && !castA && !a->IsFamily<Ternary>()) return false;
+
+	for(size_t i = 0; i < a->children.size(); ++i)
+	{
+		if(!SameValue(a->children[i], b->children[i])) return false;
+	}
+	return true;
+}
+
+NodePtr MakeNot(NodePtr operand, NodePtr origin)
+{
+	auto unOp = std::make_shared<UnaryOp>(Operator::Not);
+	unOp->type = Type::Bool;
+	unOp->pos = origin->pos;
+	unOp->line = origin->line;
+	unOp->children.push_back(operand);
+	return unOp;
+}
+
+NodePtr MakeTernary(NodePtr condition, NodePtr then, NodePtr otherwise, NodePtr origin)
+{
+	auto ternary = std::make_shared<Ternary>();
+	ternary->pos = origin->pos;
+	ternary->line = origin->line;
+	ternary->children = { condition, then, otherwise };
+	return ternary;
+}
+
+// x + 0, 0 + x -> x for integers. A float x + 0.0 turns -0.0 into 0.0.
+NodePtr AddZero(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(!binOp || binOp->op != Operator::Add || binOp->type != Type::Int) return nullptr;
+
+	if(IsConstant(binOp->children[1], 0)) return binOp->children[0];
+	if(IsConstant(binOp->children[0], 0)) return binOp->children[1];
+	return nullptr;
+}
+
+// x - 0 -> x
+NodePtr SubtractZero(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(!binOp || binOp->op != Operator::Subtract || binOp->type == Type::Bool) return nullptr;
+
+	return IsConstant(binOp->children[1], 0) ? binOp->children[0] : nullptr;
+}
+
+// x * 1, 1 * x, x / 1 -> x
+NodePtr MultiplyOne(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(!binOp || binOp->type == Type::Bool) return nullptr;
+
+	if(binOp->op == Operator::Multiply || binOp->op == Operator::Divide)
+	{
+		if(IsConstant(binOp->children[1], 1)) return binOp->children[0];
+	}
+	if(binOp->op == Operator::Multiply && IsConstant(binOp->children[0], 1)) return binOp->children[1];
+	return nullptr;
+}
+
+// x * 0, 0 * x -> 0 for integers, when x has no effects
+NodePtr MultiplyZero(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(!binOp || binOp->op != Operator::Multiply || binOp->type != Type::Int) return nullptr;
+
+	for(size_t i = 0; i < 2; ++i)
+	{
+		if(IsConstant(binOp->children[i], 0) && IsEffectFree(binOp->children[1 - i])) return binOp->children[i];
+	}
+	return nullptr;
+}
+
+// x - x -> 0 for integers, when x has no effects
+NodePtr SubtractSelf(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(!binOp || binOp->op != Operator::Subtract || binOp->type != Type::Int) return nullptr;
+
+	if(!SameValue(binOp->children[0], binOp->children[1]) || !IsEffectFree(binOp->children[0])) return nullptr;
+	return std::make_shared<Literal>(0);
+}
+
+// l1 op l2 -> l
+NodePtr FoldLiterals(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	return binOp ? FoldBinaryOp(binOp) : nullptr;
+}
+
+// b == true, b != false -> b and b == false, b != true -> !b
+NodePtr CompareBool(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(!binOp || binOp->type != Type::Bool) return nullptr;
+	if(binOp->op != Operator::Equal && binOp->op != Operator::NotEqual) return nullptr;
+
+	for(size_t i = 0; i < 2; ++i)
+	{
+		auto literal = StaticCast<Literal>(binOp->children[i]);
+		if(!literal) continue;
+
+		auto other = binOp->children[1 - i];
+		bool keep = literal->boolValue == (binOp->op == Operator::Equal);
+		return keep ? other : MakeNot(other, node);
+	}
+	return nullptr;
+}
+
+// (c ? l1 : l2) op l -> c ? (l1 op l) : (l2 op l), and likewise with the literal on the left
+NodePtr CompareTernary(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(!binOp) return nullptr;
+
+	for(size_t i = 0; i < 2; ++i)
+	{
+		auto ternary = StaticCast<Ternary>(binOp->children[i]);
+		if(!ternary || !binOp->children[1 - i]->IsFamily<Literal>()) continue;
+
+		NodePtr arms[2];
+		for(size_t arm = 0; arm < 2; ++arm)
+		{
+			if(!ternary->children[arm + 1]->IsFamily<Literal>()) return nullptr;
+
+			auto compare = std::make_shared<BinaryOp>(binOp->op);
+			compare->type = binOp->type;
+			compare->children = binOp->children;
+			compare->children[i] = ternary->children[arm + 1];
+
+			arms[arm] = FoldBinaryOp(compare);
+			if(!arms[arm]) return nullptr;
+		}
+
+		return MakeTernary(ternary->children[0], arms[0], arms[1], node);
+	}
+	return nullptr;
+}
+
+// --x -> x and !!b -> b
+NodePtr DoubleNegation(NodePtr node)
+{
+	auto unOp = StaticCast<UnaryOp>(node);
+	auto inner = unOp ? StaticCast<UnaryOp>(unOp->children[0]) : nullptr;
+
+	return inner && inner->op == unOp->op ? inner->children[0] : nullptr;
+}
+
+// !(a < b) -> a >= b and likewise for the other integer comparisons
+NodePtr NotComparison(NodePtr node)
+{
+	auto unOp = StaticCast<UnaryOp>(node);
+	if(!unOp || unOp->op != Operator::Not) return nullptr;
+
+	auto compare = StaticCast<BinaryOp>(unOp->children[0]);
+	if(!compare || compare->type != Type::Int) return nullptr;
+
+	Operator inverse;
+	switch(compare->op)
+	{
+	case Operator::Equal: inverse = Operator::NotEqual; break;
+	case Operator::NotEqual: inverse = Operator::Equal; break;
+	case Operator::Less: inverse = Operator::MoreEqual; break;
+	case Operator::LessEqual: inverse = Operator::More; break;
+	case Operator::More: inverse = Operator::LessEqual; break;
+	case Operator::MoreEqual: inverse = Operator::Less; break;
+	default: return nullptr;
+	}
+
+	auto inverted = std::make_shared<BinaryOp>(inverse);
+	inverted->type = compare->type;
+	inverted->pos = compare->pos;
+	inverted->line = compare->line;
+	inverted->children = compare->children;
+	return inverted;
+}
+
+// true ? a : b -> a and false ? a : b -> b
+NodePtr ConstantCondition(NodePtr node)
+{
+	auto ternary = StaticCast<Ternary>(node);
+	auto condition = ternary ? StaticCast<Literal>(ternary->children[0]) : nullptr;
+	if(!condition) return nullptr;
+
+	return condition->boolValue ? ternary->children[1] : ternary->children[2];
+}
+
+// c ? true : false -> c and c ? false : true -> !c
+NodePtr BoolArms(NodePtr node)
+{
+	auto ternary = StaticCast<Ternary>(node);
+	if(!ternary) return nullptr;
+
+	if(IsBoolConstant(ternary->children[1], true) && IsBoolConstant(ternary->children[2], false)) return ternary->children[0];
+	if(IsBoolConstant(ternary->children[1], false) && IsBoolConstant(ternary->children[2], true)) return MakeNot(ternary->children[0], node);
+	return nullptr;
+}
+
+// c ? a : a -> a, when c has no effects
+NodePtr EqualArms(NodePtr node)
+{
+	auto ternary = StaticCast<Ternary>(node);
+	if(!ternary || !IsEffectFree(ternary->children[0])) return nullptr;
+
+	return SameValue(ternary->children[1], ternary->children[2]) ? ternary->children[1] : nullptr;
+}
+
+// c ? c : false -> c and c ? true : c -> c, when c has no effects
+NodePtr Absorption(NodePtr node)
+{
+	auto ternary = StaticCast<Ternary>(node);
+	if(!ternary || !IsEffectFree(ternary->children[0])) return nullptr;
+
+	auto condition = ternary->children[0];
+	if(SameValue(condition, ternary->children[1]) && IsBoolConstant(ternary->children[2], false)) return condition;
+	if(IsBoolConstant(ternary->children[1], true) && SameValue(condition, ternary->children[2])) return condition;
+	return nullptr;
+}
+
+// !c ? a : b -> c ? b : a
+NodePtr NegatedCondition(NodePtr node)
+{
+	auto ternary = StaticCast<Ternary>(node);
+	auto condition = ternary ? StaticCast<UnaryOp>(ternary->children[0]) : nullptr;
+	if(!condition || condition->op != Operator::Not) return nullptr;
+
+	return MakeTernary(condition->children[0], ternary->children[2], ternary->children[1], node);
+}
+
+static const SimplifyRule rules[] =
+{
+	{ "l1 op l2 -> l", FoldLiterals },
+	{ "x + 0 -> x", AddZero },
+	{ "x - 0 -> x", SubtractZero },
+	{ "x * 1 -> x", MultiplyOne },
+	{ "x * 0 -> 0", MultiplyZero },
+	{ "x - x -> 0", SubtractSelf },
+	{ "b == true -> b", CompareBool },
+	{ "(c ? l1 : l2) op l -> c ? l1 op l : l2 op l", CompareTernary },
+	{ "--x -> x", DoubleNegation },
+	{ "!(a < b) -> a >= b", NotComparison },
+	{ "true ? a : b -> a", ConstantCondition },
+	{ "c ? true : false -> c", BoolArms },
+	{ "c ? a : a -> a", EqualArms },
+	{ "c ? c : false -> c", Absorption },
+	{ "!c ? a : b -> c ? b : a", NegatedCondition },
+};
+
+void Simplify(NodePtr& node, int& rewrites)
+{
+	for(auto& child : node->children) Simplify(child, rewrites);
+
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+
+		for(const auto& rule : rules)
+		{
+			auto result = rule.rewrite(node);
+			if(!result) continue;
+
+			if(result->IsFamily<Literal>())
+			{
+				result->pos = node->pos;
+				result->line = node->line;
+			}
+			node = result;
+			rewrites++;
+			changed = true;
+			break;
+		}
+	}
+}
+
+void SimplifyExpressions(NodePtr root, Statistics& statistics)
+{
+	int rewrites = 0, previous = -1;
+
+	// A rewrite can expose a pattern in the nodes above it that were already visited
+	while(rewrites != previous)
+	{
+		previous = rewrites;
+		Simplify(root, rewrites);
+	}
+
+	statistics["simplifier.rewrites"] += rewrites;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Rewrites expressions with a table of algebraic rules until none applies:
+// identities such as x * 1, double negation, ternaries with constant or equal
+// arms and comparisons of a ternary against a literal. These clean up the
+// trees that boolean lowering leaves behind. Rewrites are counted under
+// "simplifier.rewrites".
+void SimplifyExpressions(Nodes::NodePtr root, Statistics& statistics);
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "specialisation.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+// Small programs are budgeted as if they had this many nodes
+static const int MinimumProgramSize = 500;
+
+// Calls to one function that pass the same literals for the same parameters
+struct Specialisation
+{
+	std::shared_ptr<FunctionDef> callee;
+	// Literal arguments by parameter index
+	std::map<size_t, std::shared_ptr<Literal>> constants;
+	std::vector<std::shared_ptr<Call>> calls;
+};
+
+static int NodeCount(NodePtr root)
+{
+	int count = 0;
+	TraverseBreadth(root, [&](NodePtr, NodePtr) { count++; });
+	return count;
+}
+
+static bool IsSpecialisable(std::shared_ptr<FunctionDef> funDef)
+{
+	if(funDef->header.name == "main" || funDef->header.name == "__init") return false;
+
+	bool specialisable = true;
+	TraverseBreadth(funDef, [&](NodePtr node, NodePtr)
+	{
+		if(node != funDef && node->IsFamily<FunctionDef>()) specialisable = false;
+	});
+	return specialisable;
+}
+
+static std::string LiteralKey(std::shared_ptr<Literal> literal)
+{
+	std::stringstream sstream;
+	sstream << (int)literal->type << ':';
+	if(literal->type == Type::Float)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &literal->floatValue, sizeof(bits));
+		sstream << bits;
+	}
+	else sstream << literal->ToString();
+	return sstream.str();
+}
+
+static bool SameLiteral(std::shared_ptr<Literal> a, std::shared_ptr<Literal> b)
+{
+	return a && b && LiteralKey(a) == LiteralKey(b);
+}
+
+static std::vector<Specialisation> CollectSpecialisations(NodePtr root)
+{
+	// Parameters worth specialising, those that are read
+	std::map<NodePtr, std::set<std::string>> readParams;
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		if(!IsSpecialisable(funDef)) return;
+
+		auto& read = readParams[funDef];
+		TraverseBreadth<Identifier>(funDef, [&](std::shared_ptr<Identifier> id, NodePtr)
+		{
+			if(id->dec == funDef) read.insert(id->name);
+		});
+	});
+
+	// In the order the calls are found, so the output does not depend on addresses
+	std::vector<Specialisation> specialisations;
+	std::map<std::pair<NodePtr, std::string>, size_t> index;
+
+	TraverseBreadth<Call>(root, [&](std::shared_ptr<Call> call, NodePtr)
+	{
+		auto it = readParams.find(call->dec);
+		if(it == readParams.end()) return;
+
+		auto callee = std::static_pointer_cast<FunctionDef>(call->dec);
+		std::map<size_t, std::shared_ptr<Literal>> constants;
+		std::string key;
+		for(size_t i = 0; i < call->children.size(); ++i)
+		{
+			auto literal = StaticCast<Literal>(call->children[i]);
+			if(!literal || !it->second.count(callee->header.params[i].name)) continue;
+
+			constants[i] = literal;
+			key += std::to_string(i) + '=' + LiteralKey(literal) + ' ';
+		}
+		if(constants.empty()) return;
+
+		auto found = index.find({ callee, key });
+		if(found == index.end())
+		{
+			index[{ callee, key }] = specialisations.size();
+			specialisations.push_back({ callee, constants, {} });
+			found = index.find({ callee, key });
+		}
+		specialisations[found->second].calls.push_back(call);
+	});
+
+	return specialisations;
+}
+
+// Removes the arguments of the specialised parameters from a call to the clone
+static void RedirectCall(std::shared_ptr<Call> call, std::shared_ptr<FunctionDef> clone, const Specialisation& specialisation)
+{
+	call->dec = clone;
+	call->name = clone->header.name;
+	for(auto it = specialisation.constants.rbegin(); it != specialisation.constants.rend(); ++it)
+	{
+		call->children.erase(call->children.begin() + it->first);
+	}
+}
+
+static std::shared_ptr<FunctionDef> CloneFunction(const Specialisation& specialisation, const std::string& name)
+{
+	auto callee = specialisation.callee;
+	std::map<NodePtr, NodePtr> clones;
+	auto clone = std::static_pointer_cast<FunctionDef>(Clone(callee, clones));
+
+	clone->exp = false;
+	clone->header.name = name;
+	clone->header.params.clear();
+
+	std::map<std::string, std::shared_ptr<VarDec>> locals;
+	std::vector<NodePtr> assignments;
+	for(size_t i = 0; i < callee->header.params.size(); ++i)
+	{
+		const auto& param = callee->header.params[i];
+		auto constant = specialisation.constants.find(i);
+		if(constant == specialisation.constants.end())
+		{
+			clone->header.params.push_back(param);
+			continue;
+		}
+
+		auto local = std::make_shared<VarDec>();
+		local->var.type = param.type;
+		local->var.name = param.name;
+		locals[param.name] = local;
+
+		auto assign = std::make_shared<Assignment>(param.name);
+		assign->dec = local;
+		assign->type = param.type;
+		assign->children.push_back(std::make_shared<Literal>(*constant->second));
+		assignments.push_back(assign);
+	}
+
+	TraverseBreadth(clone, [&](NodePtr node, NodePtr)
+	{
+		auto id = StaticCast<Identifier>(node);
+		if(id && id->dec == clone && locals.count(id->name)) id->dec = locals[id->name];
+
+		auto assign = StaticCast<Assignment>(node);
+		if(assign && assign->dec == clone && locals.count(assign->name)) assign->dec = locals[assign->name];
+
+		auto ret = StaticCast<Return>(node);
+		if(ret) ret->functionName = name;
+
+		// Recursive calls stay in the clone only when they pass the same literals
+		auto call = StaticCast<Call>(node);
+		if(call && call->dec == clone)
+		{
+			bool same = true;
+			for(const auto& constant : specialisation.constants)
+			{
+				same = same && SameLiteral(StaticCast<Literal>(call->children[constant.first]), constant.second);
+			}
+
+			if(same) RedirectCall(call, clone, specialisation);
+			else call->dec = callee;
+		}
+	});
+
+	size_t position = 0;
+	while(position < clone->children.size() && clone->children[position]->IsFamily<VarDec>()) ++position;
+	clone->children.insert(clone->children.begin() + position, assignments.begin(), assignments.end());
+	for(const auto& local : locals) clone->children.insert(clone->children.begin(), local.second);
+
+	return clone;
+}
+
+void SpecialiseFunctions(NodePtr root, int growth, Statistics& statistics)
+{
+	auto specialisations = CollectSpecialisations(root);
+	std::stable_sort(specialisations.begin(), specialisations.end(), [](const Specialisation& a, const Specialisation& b)
+	{
+		return a.calls.size() > b.calls.size();
+	});
+
+	std::map<NodePtr, NodePtr> parents;
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr parent)
+	{
+		parents[funDef] = parent;
+	});
+
+	int budget = std::max(NodeCount(root), MinimumProgramSize) * growth / 100;
+	int clones = 0, calls = 0;
+
+	for(const auto& specialisation : specialisations)
+	{
+		if(specialisation.calls.size() < 2) continue;
+
+		int size = NodeCount(specialisation.callee) + 3 * specialisation.constants.size();
+		if(size > budget) continue;
+		budget -= size;
+
+		auto clone = CloneFunction(specialisation, "_S" + std::to_string(clones++) + "_" + specialisation.callee->header.name);
+		for(auto call : specialisation.calls) RedirectCall(call, clone, specialisation);
+		calls += specialisation.calls.size();
+
+		auto& siblings = parents[specialisation.callee]->children;
+		siblings.insert(std::find(siblings.begin(), siblings.end(), specialisation.callee) + 1, clone);
+	}
+
+	statistics["specialisation.clones"] += clones;
+	statistics["specialisation.calls"] += calls;
+}
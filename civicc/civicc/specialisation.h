@@ -0,0 +1,16 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Clones a function for every combination of literal arguments it is called
+// with from at least two sites. The parameters that receive a literal become
+// locals of the _S<n>_<name> clone that are assigned that literal, which
+// constant folding then propagates, and the matching calls are redirected to
+// the clone without those arguments. Functions with nested functions are not
+// cloned. The most called combinations go first, as long as the clones add no
+// more than growth percent to the number of nodes in the program, which is
+// counted as at least 500. Clones and redirected calls are counted under
+// "specialisation.clones" and "specialisation.calls".
+void SpecialiseFunctions(Nodes::NodePtr root, int growth, Statistics& statistics);
@@ -0,0 +1,27 @@
+#include <sstream>
+
+#include "statistics.h"
+
+
+std::string StatisticsToString(const Statistics& statistics)
+{
+	std::stringstream sstream;
+	for(const auto& pair : statistics) sstream << pair.first << ": " << pair.second << '\n';
+	return sstream.str();
+}
+
+Statistics StatisticsFromString(const std::string& str)
+{
+	Statistics statistics;
+	std::stringstream sstream(str);
+	std::string name;
+	int count;
+
+	while(sstream >> name >> count)
+	{
+		if(!name.empty() && name.back() == ':') name.pop_back();
+		statistics[name] = count;
+	}
+
+	return statistics;
+}
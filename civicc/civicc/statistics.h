@@ -0,0 +1,11 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+
+// Counters reported by the optimisation passes, e.g. how often a rule fired
+typedef std::map<std::string, int> Statistics;
+
+std::string StatisticsToString(const Statistics& statistics);
+Statistics StatisticsFromString(const std::string& str);
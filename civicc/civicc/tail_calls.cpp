@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "tail_calls.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+typedef std::map<NodePtr, std::vector<std::shared_ptr<Call>>> CallGraph;
+
+// Collects the calls whose value is returned as is
+void TailExpressions(NodePtr expr, std::vector<std::shared_ptr<Call>>& calls)
+{
+	auto call = StaticCast<Call>(expr);
+	if(call) calls.push_back(call);
+
+	auto ternary = StaticCast<Ternary>(expr);
+	if(ternary)
+	{
+		TailExpressions(ternary->children[1], calls);
+		TailExpressions(ternary->children[2], calls);
+	}
+}
+
+// Collects the calls that can be the last thing executed by the statements in [begin, end)
+void TailStatements(NodePtr block, size_t begin, size_t end, std::vector<std::shared_ptr<Call>>& calls)
+{
+	for(size_t i = end; i-- > begin;)
+	{
+		auto statement = block->children[i];
+		if(statement->IsFamily<FunctionDef>() || statement->IsFamily<VarDec>()) continue;
+
+		auto ret = StaticCast<Return>(statement);
+		if(ret && ret->children.empty()) continue;
+		if(ret) TailExpressions(ret->children[0], calls);
+
+		auto call = StaticCast<Call>(statement);
+		if(call) calls.push_back(call);
+
+		auto ifStatement = StaticCast<If>(statement);
+		if(ifStatement)
+		{
+			auto elseStatement = StaticCast<Else>(ifStatement->children.back());
+			if(elseStatement)
+			{
+				TailStatements(ifStatement, 1, ifStatement->children.size() - 1, calls);
+				TailStatements(elseStatement, 0, elseStatement->children.size(), calls);
+			}
+			else TailStatements(ifStatement, 1, ifStatement->children.size(), calls);
+		}
+
+		return;
+	}
+}
+
+bool Reaches(NodePtr from, NodePtr to, CallGraph& graph, std::set<NodePtr>& visited)
+{
+	if(from == to) return true;
+	if(!visited.insert(from).second) return false;
+
+	for(auto call : graph[from]) if(Reaches(call->dec, to, graph, visited)) return true;
+	return false;
+}
+
+void MarkTailCalls(NodePtr root, std::ostream& diagnostics, Statistics& statistics)
+{
+	std::map<NodePtr, NodePtr> parents;
+	CallGraph graph;
+	int eliminated = 0;
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr parent)
+	{
+		std::vector<std::shared_ptr<Call>> calls;
+		TailStatements(funDef, 0, funDef->children.size(), calls);
+
+		for(auto call : calls)
+		{
+			if(call->dec == funDef)
+			{
+				call->tail = true;
+				eliminated++;
+			}
+			else if(call->dec->IsFamily<FunctionDef>()) graph[funDef].push_back(call);
+		}
+
+		parents[funDef] = parent;
+	});
+
+	// Only sibling nested functions share a frame layout that would allow a jump between them
+	for(auto& pair : graph)
+	{
+		auto caller = StaticCast<FunctionDef>(pair.first);
+		auto& calls = pair.second;
+
+		calls.erase(std::remove_if(calls.begin(), calls.end(), [&](std::shared_ptr<Call> call)
+		{
+			return parents[call->dec] != parents[caller] || !parents[caller]->IsFamily<FunctionDef>();
+		}), calls.end());
+	}
+
+	for(auto& pair : graph)
+	{
+		auto caller = StaticCast<FunctionDef>(pair.first);
+		for(auto call : pair.second)
+		{
+			std::set<NodePtr> visited;
+			if(!Reaches(call->dec, caller, graph, visited)) continue;
+
+			auto callee = StaticCast<FunctionDef>(call->dec);
+			diagnostics << "Warning at line " << call->line << " column " << call->pos << ": ";
+			diagnostics << "mutual tail recursion between " << caller->header.name << " and " << callee->header.name;
+			diagnostics << " is not eliminated" << std::endl;
+		}
+	}
+
+	statistics["tail_calls.eliminated"] += eliminated;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <ostream>
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Marks self calls in tail position, which the generator turns into stores to
+// the parameters and a jump back to the function entry. Tail calls between
+// sibling nested functions that recurse into each other are reported as a
+// warning. Marked calls are counted under "tail_calls.eliminated".
+void MarkTailCalls(Nodes::NodePtr root, std::ostream& diagnostics, Statistics& statistics);
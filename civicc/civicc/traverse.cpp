@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "traverse.h"
 
 using namespace Nodes;
@@ -25,6 +27,88 @@ void TraverseDepth(NodePtr root, std::function<void(NodePtr, NodePtr)> func, Nod
 	}
 }
 
+void Remove(NodePtr root, const std::set<NodePtr>& nodes)
+{
+	if(root)
+	{
+		auto& list = root->children;
+		list.erase(std::remove_if(list.begin(), list.end(), [&](NodePtr child)
+		{
+			return nodes.count(child) > 0;
+		}), list.end());
+
+		for(auto child : list) Remove(child, nodes);
+	}
+}
+
+template<class T>
+NodePtr CloneAs(NodePtr node)
+{
+	return node->IsFamily<T>() ? std::make_shared<T>(*std::static_pointer_cast<T>(node)) : nullptr;
+}
+
+NodePtr CloneNode(NodePtr node)
+{
+	NodePtr clone;
+
+	if((clone = CloneAs<Root>(node))) return clone;
+	if((clone = CloneAs<FunctionDec>(node))) return clone;
+	if((clone = CloneAs<GlobalDec>(node))) return clone;
+	if((clone = CloneAs<FunctionDef>(node))) return clone;
+	if((clone = CloneAs<GlobalDef>(node))) return clone;
+	if((clone = CloneAs<VarDec>(node))) return clone;
+	if((clone = CloneAs<ArrayExpr>(node))) return clone;
+	if((clone = CloneAs<AllocateArray>(node))) return clone;
+	if((clone = CloneAs<Assignment>(node))) return clone;
+	if((clone = CloneAs<Return>(node))) return clone;
+	if((clone = CloneAs<Call>(node))) return clone;
+	if((clone = CloneAs<BinaryOp>(node))) return clone;
+	if((clone = CloneAs<UnaryOp>(node))) return clone;
+	if((clone = CloneAs<Cast>(node))) return clone;
+	if((clone = CloneAs<Literal>(node))) return clone;
+	if((clone = CloneAs<Identifier>(node))) return clone;
+	if((clone = CloneAs<Ternary>(node))) return clone;
+	if((clone = CloneAs<If>(node))) return clone;
+	if((clone = CloneAs<Else>(node))) return clone;
+	if((clone = CloneAs<While>(node))) return clone;
+	if((clone = CloneAs<DoWhile>(node))) return clone;
+	if((clone = CloneAs<For>(node))) return clone;
+
+	assert(false && "Unknown node type");
+	return nullptr;
+}
+
+NodePtr CloneTree(NodePtr root, std::map<NodePtr, NodePtr>& clones)
+{
+	auto it = clones.find(root);
+	if(it != clones.end()) return it->second;
+
+	auto clone = CloneNode(root);
+	clones[root] = clone;
+	for(auto& child : clone->children) child = CloneTree(child, clones);
+
+	return clone;
+}
+
+NodePtr Clone(NodePtr root, std::map<NodePtr, NodePtr>& clones)
+{
+	auto clone = CloneTree(root, clones);
+
+	TraverseBreadth(clone, [&](NodePtr node, NodePtr)
+	{
+		auto id = StaticCast<Identifier>(node);
+		if(id && clones.count(id->dec)) id->dec = clones[id->dec];
+
+		auto assign = StaticCast<Assignment>(node);
+		if(assign && clones.count(assign->dec)) assign->dec = clones[assign->dec];
+
+		auto call = StaticCast<Call>(node);
+		if(call && clones.count(call->dec)) call->dec = clones[call->dec];
+	});
+
+	return clone;
+}
+
 int Count(NodePtr root, NodePtr val)
 {
 	int count = 0;
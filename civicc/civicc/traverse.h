@@ -3,6 +3,8 @@
 #include <string>
 #include <memory>
 #include <functional>
+#include <set>
+#include <map>
 
 #include "node.h"
 
@@ -87,6 +89,14 @@ int Count(Nodes::NodePtr root)
 	return count;
 }
 
+// Deep copies a tree. Nodes shared within the tree stay shared in the copy,
+// and references to declarations that were copied are redirected to the copy.
+// The clones map holds the copy of every original node afterwards.
+Nodes::NodePtr Clone(Nodes::NodePtr root, std::map<Nodes::NodePtr, Nodes::NodePtr>& clones);
+
+// Removes every occurrence of the given nodes from the tree
+void Remove(Nodes::NodePtr root, const std::set<Nodes::NodePtr>& nodes);
+
 int Count(Nodes::NodePtr root, Nodes::NodePtr val);
 
 std::string TreeToJSON(Nodes::NodePtr root);
\ No newline at end of file
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "value_numbering.h"
+#include "assembly.h"
+#include "traverse.h"
+
+using namespace Nodes;
+
+
+struct Occurrence
+{
+	NodePtr parent;
+	size_t index;
+	NodePtr statement;
+};
+
+struct ValueContext
+{
+	std::map<std::string, int> versions;
+	int epoch = 0;
+	std::map<std::string, std::vector<Occurrence>> occurrences;
+};
+
+struct FunctionValues
+{
+	// Variables that only this function can read or write, so calls can not change them
+	std::set<std::string> privateVars;
+	std::vector<NodePtr> temporaries;
+	int& counter;
+	int reused = 0;
+
+	FunctionValues(int& counter) : counter(counter) {}
+};
+
+std::string VariableKey(NodePtr dec, const std::string& name)
+{
+	std::stringstream sstream;
+	sstream << dec.get() << name;
+	return sstream.str();
+}
+
+Type ValueType(NodePtr node)
+{
+	auto binOp = StaticCast<BinaryOp>(node);
+	if(binOp)
+	{
+		switch(binOp->op)
+		{
+		case Operator::Add: case Operator::Subtract: case Operator::Multiply: case Operator::Divide: case Operator::Modulo:
+			return binOp->type;
+		default:
+			return Type::Bool;
+		}
+	}
+
+	auto unOp = StaticCast<UnaryOp>(node);
+	if(unOp) return unOp->type;
+
+	return StaticCast<Cast>(node)->type;
+}
+
+// Returns a key that is equal for expressions with equal values, or an empty
+// string when the value of the expression can not be reused. Every reusable
+// operator expression is recorded as an occurrence of its key.
+std::string ValueKey(NodePtr node, NodePtr parent, size_t index, NodePtr statement, bool hasCall, FunctionValues& function, ValueContext& context)
+{
+	std::stringstream sstream;
+
+	auto literal = StaticCast<Literal>(node);
+	if(literal)
+	{
+		uint32_t bits = 0;
+		if(literal->type == Type::Float) std::memcpy(&bits, &literal->floatValue, sizeof(bits));
+		else bits = literal->type == Type::Int ? (uint32_t)literal->intValue : literal->boolValue;
+
+		sstream << 'l' << (int)literal->type << ':' << bits;
+		return sstream.str();
+	}
+
+	auto id = StaticCast<Identifier>(node);
+	if(id)
+	{
+		auto var = VariableKey(id->dec, id->name);
+		bool isPrivate = function.privateVars.count(var) > 0;
+
+		// The order of a call and a read in the same statement is unknown
+		if(!isPrivate && hasCall) return "";
+
+		sstream << 'v' << var << '#' << context.versions[var];
+		if(!isPrivate) sstream << 'e' << context.epoch;
+		return sstream.str();
+	}
+
+	// Ternary operands are evaluated conditionally
+	if(node->IsFamily<Ternary>() || node->IsFamily<ArrayExpr>()) return "";
+
+	std::vector<std::string> keys;
+	bool valid = true;
+	for(size_t i = 0; i < node->children.size(); ++i)
+	{
+		keys.push_back(ValueKey(node->children[i], node, i, statement, hasCall, function, context));
+		if(keys.back().empty()) valid = false;
+	}
+	if(!valid || node->IsFamily<Call>()) return "";
+
+	auto binOp = StaticCast<BinaryOp>(node);
+	auto unOp = StaticCast<UnaryOp>(node);
+	auto cast = StaticCast<Cast>(node);
+
+	if(binOp)
+	{
+		// Moving a division in front of other parts of the statement could move its trap
+		if(binOp->op == Operator::Divide || binOp->op == Operator::Modulo) return "";
+
+		bool commutative = binOp->op == Operator::Add || binOp->op == Operator::Multiply ||
+			binOp->op == Operator::Equal || binOp->op == Operator::NotEqual;
+		if(commutative) std::sort(keys.begin(), keys.end());
+
+		sstream << 'b' << (int)binOp->op << '(' << keys[0] << ',' << keys[1] << ')';
+	}
+	else if(unOp) sstream << 'u' << (int)unOp->op << '(' << keys[0] << ')';
+	else if(cast)
+	{
+		if(cast->castFrom == cast->type) return keys[0];
+		sstream << 'c' << (int)cast->type << '(' << keys[0] << ')';
+	}
+	else return "";
+
+	context.occurrences[sstream.str()].push_back({ parent, index, statement });
+	return sstream.str();
+}
+
+bool IsStraightLine(NodePtr statement)
+{
+	return statement->IsFamily<Assignment>() || statement->IsFamily<Call>() || statement->IsFamily<Return>();
+}
+
+// Finds the most profitable repeated expression in a run of straight-line
+// statements and stores it in a temporary. Returns whether anything changed.
+bool NumberSegment(NodePtr block, const std::vector<NodePtr>& segment, FunctionValues& function)
+{
+	ValueContext context;
+
+	for(auto statement : segment)
+	{
+		bool hasCall = Count<Call>(statement) > 0;
+
+		for(size_t i = 0; i < statement->children.size(); ++i)
+		{
+			ValueKey(statement->children[i], statement, i, statement, hasCall, function, context);
+		}
+
+		auto assign = StaticCast<Assignment>(statement);
+		if(assign) context.versions[VariableKey(assign->dec, assign->name)]++;
+		if(hasCall) context.epoch++;
+	}
+
+	int bestGain = 0;
+	std::vector<Occurrence>* best = nullptr;
+	for(auto& pair : context.occurrences)
+	{
+		// One store and one load extra, against the instructions saved per reuse
+		int count = (int)pair.second.size();
+		int size = InstructionCount(pair.second.front().parent->children[pair.second.front().index]);
+		int gain = (count - 1) * (size - 1) - 2;
+
+		if(gain > bestGain)
+		{
+			bestGain = gain;
+			best = &pair.second;
+		}
+	}
+	if(!best) return false;
+
+	const auto& first = best->front();
+	auto value = first.parent->children[first.index];
+	auto type = ValueType(value);
+
+	std::stringstream name;
+	name << "_T" << function.counter++;
+
+	auto temp = std::make_shared<VarDec>();
+	temp->var.type = type;
+	temp->var.name = name.str();
+	function.temporaries.push_back(temp);
+	function.privateVars.insert(VariableKey(temp, temp->var.name));
+
+	auto assign = std::make_shared<Assignment>(temp->var.name);
+	assign->dec = temp;
+	assign->type = type;
+	assign->children.push_back(value);
+
+	for(const auto& occurrence : *best)
+	{
+		auto id = std::make_shared<Identifier>(temp->var.name);
+		id->dec = temp;
+		id->type = type;
+		occurrence.parent->children[occurrence.index] = id;
+	}
+
+	auto it = std::find(block->children.begin(), block->children.end(), first.statement);
+	block->children.insert(it, assign);
+	function.reused += (int)best->size() - 1;
+
+	return true;
+}
+
+// Numbers the statements of a block, excluding the trailing children that are not statements
+void NumberBlock(NodePtr block, size_t begin, size_t trailing, FunctionValues& function)
+{
+	bool changed = true;
+
+	while(changed)
+	{
+		changed = false;
+
+		std::vector<NodePtr> segment;
+		for(size_t i = begin; i + trailing <= block->children.size() && !changed; ++i)
+		{
+			bool end = i + trailing == block->children.size();
+			auto statement = end ? nullptr : block->children[i];
+
+			if(statement && (statement->IsFamily<VarDec>() || statement->IsFamily<FunctionDef>())) continue;
+			if(statement && IsStraightLine(statement))
+			{
+				segment.push_back(statement);
+				continue;
+			}
+
+			changed = NumberSegment(block, segment, function);
+			segment.clear();
+		}
+	}
+}
+
+void NumberValues(NodePtr root, Statistics& statistics)
+{
+	std::map<NodePtr, NodePtr> owner;
+	std::set<std::string> captured;
+	int counter = 0, reused = 0, temporaries = 0;
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		owner[funDef] = funDef;
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			owner[node] = funDef;
+		});
+	});
+
+	TraverseBreadth(root, [&](NodePtr node, NodePtr)
+	{
+		auto id = StaticCast<Identifier>(node);
+		if(id && owner[id] != owner[id->dec]) captured.insert(VariableKey(id->dec, id->name));
+
+		auto assign = StaticCast<Assignment>(node);
+		if(assign && owner[assign] != owner[assign->dec]) captured.insert(VariableKey(assign->dec, assign->name));
+	});
+
+	TraverseBreadth<FunctionDef>(root, [&](std::shared_ptr<FunctionDef> funDef, NodePtr)
+	{
+		FunctionValues function(counter);
+
+		for(const auto& param : funDef->header.params)
+		{
+			auto var = VariableKey(funDef, param.name);
+			if(param.dim.empty() && !captured.count(var)) function.privateVars.insert(var);
+		}
+
+		std::vector<NodePtr> blocks;
+		TraverseNot<FunctionDef>(funDef, [&](NodePtr node, NodePtr)
+		{
+			auto varDec = StaticCast<VarDec>(node);
+			if(varDec && !varDec->var.array)
+			{
+				auto var = VariableKey(varDec, varDec->var.name);
+				if(!captured.count(var)) function.privateVars.insert(var);
+			}
+
+			if(node->IsFamily<If>() || node->IsFamily<Else>() || node->IsFamily<DoWhile>()) blocks.push_back(node);
+		});
+
+		NumberBlock(funDef, 0, 0, function);
+		for(auto block : blocks)
+		{
+			if(block->IsFamily<If>())
+			{
+				bool hasElse = block->children.back()->IsFamily<Else>();
+				NumberBlock(block, 1, hasElse ? 1 : 0, function);
+			}
+			else if(block->IsFamily<DoWhile>()) NumberBlock(block, 0, 1, function);
+			else NumberBlock(block, 0, 0, function);
+		}
+
+		funDef->children.insert(funDef->children.begin(), function.temporaries.begin(), function.temporaries.end());
+		reused += function.reused;
+		temporaries += (int)function.temporaries.size();
+	});
+
+	statistics["value_numbering.reused"] += reused;
+	statistics["value_numbering.temporaries"] += temporaries;
+}
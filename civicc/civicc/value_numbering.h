@@ -0,0 +1,12 @@
+#pragma once
+
+#include "node.h"
+#include "statistics.h"
+
+
+// Local value numbering over runs of straight-line statements. An expression
+// that is computed more than once with the same operand values is stored in
+// a fresh _T local before its first use and loaded from there afterwards,
+// when that saves instructions. Reused expressions are counted under
+// "value_numbering.reused" and the added locals under "value_numbering.temporaries".
+void NumberValues(Nodes::NodePtr root, Statistics& statistics);
@@ -0,0 +1,103 @@
+/* Runtime for the C backend of civicc (--emit-c). Provides the functions of
+ * civic.h and the array allocation used by the generated code, with the same
+ * output formats as civvm, and the counter of --instrument. Build a program with:
+ *
+ *   civicc --emit-c -o program.c program.cvc
+ *   cc -O2 -fwrapv program.c runtime/civic_runtime.c -o program
+ */
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void printInt(int64_t val)
+{
+	printf("%" PRId64, val);
+}
+
+void printFloat(double val)
+{
+	printf("%f", val);
+}
+
+int64_t scanInt(void)
+{
+	int64_t val = 0;
+	if(scanf("%" SCNd64, &val) != 1) val = 0;
+	return val;
+}
+
+double scanFloat(void)
+{
+	double val = 0;
+	if(scanf("%lf", &val) != 1) val = 0;
+	return val;
+}
+
+void printSpaces(int64_t num)
+{
+	for(int64_t i = 0; i < num; ++i) putchar(' ');
+}
+
+void printNewlines(int64_t num)
+{
+	for(int64_t i = 0; i < num; ++i) putchar('\n');
+}
+
+void* civic_alloc(int64_t count, int64_t size)
+{
+	void* elements;
+
+	if(count <= 0)
+	{
+		fprintf(stderr, "Exception: invalid bound size in array creation\n");
+		exit(1);
+	}
+
+	elements = calloc((size_t)count, (size_t)size);
+	if(!elements)
+	{
+		fprintf(stderr, "Exception: out of memory in array creation\n");
+		exit(1);
+	}
+
+	return elements;
+}
+
+/* Counts of the profile points of a program built with --instrument, written
+ * in the format of profile.h to $CIVIC_PROFILE, or civic.prof, at exit */
+static int64_t* profileCounts;
+static int64_t profileSize;
+
+static void civic_write_profile(void)
+{
+	const char* name = getenv("CIVIC_PROFILE");
+	FILE* file = fopen(name ? name : "civic.prof", "w");
+	if(!file) return;
+
+	fprintf(file, "civicc-profile 1\n");
+	for(int64_t id = 0; id < profileSize; ++id)
+	{
+		if(profileCounts[id]) fprintf(file, "%" PRId64 " %" PRId64 "\n", id, profileCounts[id]);
+	}
+	fclose(file);
+}
+
+void __profile_count(int64_t id)
+{
+	if(id >= profileSize)
+	{
+		int64_t size = profileSize ? profileSize : 64;
+		while(size <= id) size *= 2;
+
+		int64_t* counts = realloc(profileCounts, (size_t)size * sizeof(int64_t));
+		if(!counts) return;
+		for(int64_t i = profileSize; i < size; ++i) counts[i] = 0;
+
+		if(!profileCounts) atexit(civic_write_profile);
+		profileCounts = counts;
+		profileSize = size;
+	}
+
+	profileCounts[id]++;
+}
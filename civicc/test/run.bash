@@ -4,6 +4,10 @@ CIVVM=${CIVVM-../bin32/civvm}
 CIVCC=${CIVCC-../bin/civicc}
 CFLAGS=${CFLAGS-}
 RUN_FUNCTIONAL=${RUN_FUNCTIONAL-1}
+# Comma separated list of extra backends to run the functional tests with: c, native
+BACKENDS=${BACKENDS-}
+CC=${CC-cc}
+RUNTIME=${RUNTIME-../bin/civic_runtime.o}
 
 ALIGN=52
 
@@ -18,6 +22,35 @@ function echo_failed {
     echo -e '\E[27;31m'"\033[1mfailed\033[0m"
 }
 
+# Prints the failure of the current test together with the output of the step
+# that failed, which is in tmp.out.
+function report_failure {
+    echo_failed
+    echo -------------------------------
+    cat tmp.out
+    echo -------------------------------
+    echo
+    failed_tests=$((failed_tests+1))
+}
+
+# Runs the command in the remaining arguments and compares its output to the
+# expected output in the first argument.
+function run_program {
+    expect_file=$1
+    shift
+
+    if "$@" > tmp.out 2>&1 &&
+       mv tmp.out tmp.res &&
+       diff tmp.res $expect_file --side-by-side --ignore-space-change > tmp.out 2>&1
+    then
+        echo_success
+    else
+        report_failure
+    fi
+
+    rm -f tmp.res tmp.out
+}
+
 # The real tests: compile a file, run it, and compare the output to the
 # expected output.
 function check_output {
@@ -29,23 +62,59 @@ function check_output {
     total_tests=$((total_tests+1))
     printf "%-${ALIGN}s " $file:
     
-    if $CIVCC $CGLAGS -o tmp.s $file > tmp.out 2>&1 &&
-       $CIVAS tmp.s -o tmp.o > tmp.out 2>&1 &&
-       $CIVVM tmp.o > tmp.out 2>&1 &&
-       mv tmp.out tmp.res &&
-       diff tmp.res $expect_file --side-by-side --ignore-space-change > tmp.out 2>&1
+    if $CIVCC $CFLAGS -o tmp.s $file > tmp.out 2>&1 &&
+       $CIVAS tmp.s -o tmp.o > tmp.out 2>&1
     then
-        echo_success
+        run_program $expect_file $CIVVM tmp.o
     else
-        echo_failed
-        echo -------------------------------
-        cat tmp.out
-        echo -------------------------------
-        echo
-        failed_tests=$((failed_tests+1))
+        report_failure
     fi
 
-    rm -f tmp.res tmp.s tmp.o tmp.out
+    rm -f tmp.s tmp.o tmp.out
+}
+
+# The functional tests again, compiled with the C backend and linked with the
+# runtime. The program must print the same as on civvm. The C compiler has to
+# optimise for the tail calls in the generated code to stay tail calls.
+function check_c {
+    file=$1
+    expect_file=${file%.*}.out
+
+    if [ ! -f $file ]; then return; fi
+
+    total_tests=$((total_tests+1))
+    printf "%-${ALIGN}s " "$file (c):"
+
+    if $CIVCC $CFLAGS --emit-c -o tmp.c $file > tmp.out 2>&1 &&
+       $CC -std=c99 -O2 -fwrapv -o tmp.exe tmp.c $RUNTIME > tmp.out 2>&1
+    then
+        run_program $expect_file ./tmp.exe
+    else
+        report_failure
+    fi
+
+    rm -f tmp.c tmp.exe tmp.out
+}
+
+# Same as check_c, but with the native x86-64 backend.
+function check_native {
+    file=$1
+    expect_file=${file%.*}.out
+
+    if [ ! -f $file ]; then return; fi
+
+    total_tests=$((total_tests+1))
+    printf "%-${ALIGN}s " "$file (native):"
+
+    if $CIVCC $CFLAGS --emit-native -o tmp_native.s $file > tmp.out 2>&1 &&
+       $CC -o tmp.exe tmp_native.s $RUNTIME > tmp.out 2>&1
+    then
+        run_program $expect_file ./tmp.exe
+    else
+        report_failure
+    fi
+
+    rm -f tmp_native.s tmp.exe tmp.out
 }
 
 # Special case: multiple files must be compiled and run together (e.g., for
@@ -72,7 +141,7 @@ function check_combined {
         ofile=${file%.*}.o
         ofiles="$ofiles $ofile"
 
-        if $CIVCC $CGLAGS -o $asfile $file &&
+        if $CIVCC $CFLAGS -o $asfile $file &&
            $CIVAS -o $ofile $asfile
         then
             compiled_files="$compiled_files `basename $file`"
@@ -83,25 +152,37 @@ function check_combined {
 
     if [ $compiled -eq 1 ]
     then
-        if $CIVVM $ofiles > tmp.out 2>&1 &&
-           mv tmp.out tmp.res &&
-           diff tmp.res $expect_file --side-by-side --ignore-space-change > tmp.out 2>&1
-        then
-            echo_success
-        else
-            echo_failed
-            echo -------------------------------
-            cat tmp.out
-            echo -------------------------------
-            echo
-            failed_tests=$((failed_tests+1))
-        fi
+        run_program $expect_file $CIVVM $ofiles
     else
         echo "failed, only compiled$compiled_files"
         failed_tests=$((failed_tests+1))
     fi
 
-    rm -f $d/*.s $d/*.o tmp.out tmp.res
+    rm -f $dir/*.s $dir/*.o
+}
+
+# Same as check_combined, but compiles all the *.cvc files in the directory
+# together with --whole-program into a single object.
+function check_whole_program {
+    dir=$1
+    expect_file=$dir/expected.out
+
+    if [ ! -d $dir ]; then return; fi
+    if [ ! -f $expect_file ]; then return; fi
+
+    files=`find $dir -maxdepth 1 -name \*.cvc`
+    total_tests=$((total_tests+1))
+    printf "%-${ALIGN}s " "$dir (whole program):"
+
+    if $CIVCC $CFLAGS --whole-program -o tmp.s $files > tmp.out 2>&1 &&
+       $CIVAS tmp.s -o tmp.o > tmp.out 2>&1
+    then
+        run_program $expect_file $CIVVM tmp.o
+    else
+        report_failure
+    fi
+
+    rm -f tmp.s tmp.o tmp.out
 }
 
 # Easy tests, check if the parser, context analysis and typechecking work
@@ -156,9 +237,19 @@ function run_dir {
             check_output $f
         done
 
+        for backend in ${BACKENDS//,/ }; do
+            for f in $BASE/functional/*.cvc; do
+                check_$backend $f
+            done
+        done
+
         for d in $BASE/combined_*; do
             check_combined $d
         done
+
+        for d in $BASE/combined_*; do
+            check_whole_program $d
+        done
     fi
 
     echo